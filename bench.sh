@@ -0,0 +1,39 @@
+#!/bin/bash
+# Exit on errors
+set -o errexit
+
+# Library sources
+LIBS="lib/* tests/*"
+
+function bench {
+  # Compile and run a benchmark file with optimizations on
+  bench_file=$1
+  binary=bin/$(basename $bench_file .cpp)
+
+  # Clean output
+  echo Cleaning $binary
+  rm -f $binary
+
+  # Build benchmark
+  echo Building $bench_file
+  clang++ -std=c++17 -O2 -pthread $bench_file $LIBS
+  mv a.out $binary
+  echo Done!
+
+  echo Running $binary
+  if [ $# -gt 1 ]
+  then
+    shift
+    $binary "$@"
+  else
+    $binary
+  fi
+}
+
+# ./bench.sh json [max_size] [max_num_splitters] prints every timing as JSON
+if [ $# -gt 0 ]
+  then
+  bench run_benchmarks.cpp "$@"
+else
+  bench run_benchmarks.cpp
+fi
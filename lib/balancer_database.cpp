@@ -0,0 +1,174 @@
+// Minimal balancer sizes, kept on disk between runs
+
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <type_traits>
+
+#include "balancer_database.hpp"
+
+namespace {
+
+const char table_magic[8] = {'B', 'A', 'L', 'T', 'A', 'B', 'L', 'E'};
+const uint32_t table_version = 1;
+
+struct TableHeader {
+  char magic[8];
+  uint32_t version;
+  // 1 for exact fractions
+  uint32_t exact;
+  // Entries of level_ends, then of the table
+  uint32_t levels;
+  uint32_t balancers;
+};
+
+struct TableEntry {
+  int32_t input_size;
+  int32_t output_size;
+  int32_t splitters;
+};
+
+string flowsPath(const string& path) {
+  return path + ".flows";
+}
+
+}  // namespace
+
+template <class M>
+BasicBalancerDatabase<M>::BasicBalancerDatabase(string database_path, SearchOptions search_options)
+    : path(move(database_path)), options(move(search_options)) {
+  options.prune = false;
+  options.checkpoint_path.clear();
+  options.memory_limit = 0;
+
+  if (filesystem::exists(path)) {
+    loadTable();
+  } else {
+    // {{1}} is the 1 -> 1 balancer, with no splitters
+    level_ends = {1};
+    first_level[key(1, 1)] = 0;
+  }
+}
+
+template <class M>
+int BasicBalancerDatabase<M>::minSplitters(int input_size, int output_size, int max_num_splitters) {
+  if (max_num_splitters > splitters()) {
+    extend(max_num_splitters);
+  }
+  auto found = first_level.find(key(input_size, output_size));
+  if (found == first_level.end() || found->second > max_num_splitters) {
+    return -1;
+  }
+  return found->second;
+}
+
+template <class M>
+void BasicBalancerDatabase<M>::extend(int max_num_splitters) {
+  if (state == nullptr) {
+    state = make_unique<SearchState<M>>();
+    if (filesystem::exists(flowsPath(path))) {
+      loadCheckpoint(flowsPath(path), *state);
+    } else {
+      state->input_size = 1;
+      state->output_size = 1;
+      state->visited.insert({{1}});
+      state->frontier.push_back(0);
+    }
+    if (state->level != splitters() || state->visited.size() != level_ends.back()) {
+      throw "Balancer database flows don't match its table";
+    }
+  }
+
+  int searched = splitters();
+  expandSearch(*state, max_num_splitters, options, &level_ends);
+
+  // Once no new flows turn up, more splitters don't make any either
+  if (state->frontier.empty()) {
+    state->level = max_num_splitters;
+  }
+  level_ends.resize(max_num_splitters + 1, level_ends.back());
+
+  // Balancers among each level's new flows; earlier levels' entries stay
+  for (int level = searched + 1; level <= max_num_splitters; ++level) {
+    for (size_t i = level_ends[level - 1]; i < level_ends[level]; ++i) {
+      M flow = state->visited[i];
+      if (isBalancer(flow)) {
+        first_level.emplace(key(flow.cols(), flow.rows()), level);
+      }
+    }
+  }
+
+  saveCheckpoint(flowsPath(path), *state);
+  saveTable();
+}
+
+template <class M>
+void BasicBalancerDatabase<M>::loadTable() {
+  FILE* file = fopen(path.c_str(), "rb");
+  if (file == nullptr) {
+    throw "Can't open balancer database";
+  }
+
+  TableHeader header;
+  bool read = fread(&header, sizeof(header), 1, file) == 1;
+  if (!read || memcmp(header.magic, table_magic, sizeof(table_magic)) != 0) {
+    fclose(file);
+    throw "Not a balancer database";
+  }
+  if (header.version != table_version || header.levels == 0) {
+    fclose(file);
+    throw "Unsupported balancer database version";
+  }
+  if (header.exact != is_same<typename M::value_type, Rational>::value) {
+    fclose(file);
+    throw "Balancer database has a different value type";
+  }
+
+  vector<uint64_t> ends(header.levels);
+  vector<TableEntry> entries(header.balancers);
+  read = fread(ends.data(), sizeof(ends[0]), ends.size(), file) == ends.size() &&
+         fread(entries.data(), sizeof(entries[0]), entries.size(), file) == entries.size();
+  fclose(file);
+  if (!read) {
+    throw "Balancer database is truncated";
+  }
+
+  level_ends.assign(ends.begin(), ends.end());
+  first_level.clear();
+  for (const TableEntry& entry : entries) {
+    first_level[key(entry.input_size, entry.output_size)] = entry.splitters;
+  }
+}
+
+template <class M>
+void BasicBalancerDatabase<M>::saveTable() const {
+  TableHeader header = {};
+  memcpy(header.magic, table_magic, sizeof(table_magic));
+  header.version = table_version;
+  header.exact = is_same<typename M::value_type, Rational>::value;
+  header.levels = level_ends.size();
+  header.balancers = first_level.size();
+
+  vector<uint64_t> ends(level_ends.begin(), level_ends.end());
+  vector<TableEntry> entries;
+  for (auto& entry : first_level) {
+    entries.push_back({(int32_t)(entry.first >> 32), (int32_t)(uint32_t)entry.first, entry.second});
+  }
+
+  // Replace the old table only once the new one is whole
+  string temporary_path = path + ".tmp";
+  FILE* file = fopen(temporary_path.c_str(), "wb");
+  if (file == nullptr) {
+    throw "Can't write balancer database";
+  }
+  bool written = fwrite(&header, sizeof(header), 1, file) == 1 &&
+                 fwrite(ends.data(), sizeof(ends[0]), ends.size(), file) == ends.size() &&
+                 fwrite(entries.data(), sizeof(entries[0]), entries.size(), file) == entries.size();
+  written = fclose(file) == 0 && written;
+  if (!written || rename(temporary_path.c_str(), path.c_str()) != 0) {
+    throw "Can't write balancer database";
+  }
+}
+
+template class BasicBalancerDatabase<Matrix>;
+template class BasicBalancerDatabase<ExactMatrix>;
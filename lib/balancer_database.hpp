@@ -0,0 +1,67 @@
+// Minimal balancer sizes, kept on disk between runs
+
+#pragma once
+
+#include <string>
+#include <unordered_map>
+
+#include "types.hpp"
+#include "checkpoint.hpp"
+#include "exists_balancer.hpp"
+
+// Which balancers first show up with how many splitters. Without pruning, the
+// flows k splitters can make are the same whatever balancer is asked for, so
+// they are searched for once, level by level, and every balancer among each
+// level's new flows is put in a table. Queries up to the levels searched so
+// far are lookups in that table; a query for more splitters carries on with
+// the search from where it was, and saves the result.
+//
+// The database is two files: path has the table, and path + ".flows" is a
+// checkpoint (see checkpoint.hpp) of every flow found, in level order. The
+// flows are only loaded when the search has to carry on.
+template <class M>
+class BasicBalancerDatabase {
+ public:
+  // Open the database at path, or start an empty one if there's none yet.
+  // options are used when carrying on the search; pruning and checkpoints
+  // are always off.
+  explicit BasicBalancerDatabase(string path, SearchOptions options = SearchOptions());
+
+  // Fewest splitters an input_size -> output_size balancer can be built from,
+  // or -1 if it needs more than max_num_splitters
+  int minSplitters(int input_size, int output_size, int max_num_splitters);
+
+  // The same answer as existsBalancer<M>(input_size, output_size, max_num_splitters)
+  bool exists(int input_size, int output_size, int max_num_splitters) {
+    return minSplitters(input_size, output_size, max_num_splitters) != -1;
+  }
+
+  // Splitters every flow has been found for
+  int splitters() const { return (int)level_ends.size() - 1; }
+
+  // How many flows up to max_num_splitters splitters can make, for
+  // max_num_splitters <= splitters()
+  size_t flowCount(int max_num_splitters) const { return level_ends[max_num_splitters]; }
+
+ private:
+  // Search until every flow of max_num_splitters splitters is found, and save
+  void extend(int max_num_splitters);
+  void loadTable();
+  void saveTable() const;
+
+  static uint64_t key(int input_size, int output_size) {
+    return (uint64_t)(uint32_t)input_size << 32 | (uint32_t)output_size;
+  }
+
+  string path;
+  SearchOptions options;
+  // Number of flows found with up to each number of splitters
+  vector<size_t> level_ends;
+  // Fewest splitters for each balancer found, by key()
+  unordered_map<uint64_t, int> first_level;
+  // Loaded or started when the search has to carry on
+  unique_ptr<SearchState<M>> state;
+};
+
+using BalancerDatabase = BasicBalancerDatabase<Matrix>;
+using ExactBalancerDatabase = BasicBalancerDatabase<ExactMatrix>;
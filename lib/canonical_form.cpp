@@ -0,0 +1,452 @@
+// Canonical form of a flow matrix under row and column permutations
+
+#include <algorithm>
+#include <deque>
+#include <numeric>
+
+#include "hashing.hpp"
+#include "network_tools.hpp"
+#include "search_stats.hpp"
+#include "canonical_form.hpp"
+
+namespace {
+
+// Bits of a refinement key below the line's colour
+const int color_shift = 48;
+
+// Colours of the rows and columns. A colour is the position where its cell
+// starts in the final order, so cells keep their relative order as they split.
+struct Coloring {
+  vector<int> row_color;
+  vector<int> col_color;
+  // Whether the last refinement pass of each axis left only cells whose
+  // members are identical lines, which no further pass can split; false if
+  // the axis hasn't been refined since it last changed
+  bool rows_settled = false;
+  bool cols_settled = false;
+  // Lines already individualized at this node
+  vector<int> tried;
+  // On the first path: the axis branched on, and a union-find of its lines
+  // under the automorphisms found so far, which fix this node
+  bool branch_by_rows;
+  vector<int> orbits;
+};
+
+// Canonical labeling by colour refinement and individualization. One instance
+// per thread is reused across calls, so its buffers only grow during warm-up.
+template <class M>
+class Canonizer {
+ public:
+  using T = typename M::value_type;
+
+  M run(const M& input, vector<int>* row_order, vector<int>* col_order) {
+    matrix = &input;
+    rows = input.rows();
+    cols = input.cols();
+    found = false;
+    best_is_first = true;
+    backtrack_to = -1;
+
+    value_hashes.resize(rows * cols);
+    for (int i = 0; i < rows; ++i) {
+      for (int j = 0; j < cols; ++j) {
+        value_hashes[i * cols + j] = mix64(scalarBits(input[i][j]));
+      }
+    }
+    for (int c = color_factors.size(); c < max(rows, cols); ++c) {
+      color_factors.push_back(mix64(c + 1) | 1);
+    }
+
+    if (stack.empty()) {
+      stack.resize(1);
+    }
+    stack[0].row_color.assign(rows, 0);
+    stack[0].col_color.assign(cols, 0);
+    stack[0].rows_settled = false;
+    stack[0].cols_settled = false;
+    refineLines(true, stack[0]);
+    refine(stack[0], false);
+    search(0, true, 0);
+
+    if (row_order != nullptr) {
+      *row_order = best_rows;
+    }
+    if (col_order != nullptr) {
+      *col_order = best_cols;
+    }
+    return move(best);
+  }
+
+ private:
+  T at(bool by_rows, int line, int other) const {
+    return by_rows ? (*matrix)[line][other] : (*matrix)[other][line];
+  }
+
+  // Swapping two identical rows (or columns) doesn't change the matrix, so
+  // only one of them ever has to be individualized
+  bool identicalLines(bool by_rows, int a, int b) const {
+    int width = by_rows ? cols : rows;
+    for (int k = 0; k < width; ++k) {
+      if (at(by_rows, a, k) != at(by_rows, b, k)) {
+        return false;
+      }
+    }
+    return true;
+  }
+
+  // Split each cell of rows (or columns) by a hash of the multiset of
+  // (colour, value) pairs along each line: the sum of each value's hash times
+  // a random odd factor for its colour. The hash doesn't depend on how the
+  // matrix is labelled, so neither does the refinement; lines whose hashes
+  // collide just stay in one cell until they are individualized.
+  // Returns whether any cell was split.
+  bool refineLines(bool by_rows, Coloring& coloring) {
+    countSearchStat(&SearchCounters::refinement_passes);
+    vector<int>& colors = by_rows ? coloring.row_color : coloring.col_color;
+    const vector<int>& others = by_rows ? coloring.col_color : coloring.row_color;
+    int lines = colors.size();
+    int width = others.size();
+
+    // Each line's colour in the top bits and its hash below, so lines sort by
+    // colour first and a cell's members end up next to each other
+    int line_step = by_rows ? cols : 1;
+    int other_step = by_rows ? 1 : cols;
+    keys.resize(lines);
+    order.resize(lines);
+    for (int i = 0; i < lines; ++i) {
+      uint64_t hash = 0;
+      for (int j = 0; j < width; ++j) {
+        hash += value_hashes[i * line_step + j * other_step] * color_factors[others[j]];
+      }
+      uint64_t key = (uint64_t)colors[i] << color_shift | hash >> (64 - color_shift);
+
+      // Flows have few lines, so an insertion sort beats std::sort's setup
+      int at = i;
+      for (; at > 0 && key < keys[at - 1]; --at) {
+        keys[at] = keys[at - 1];
+        order[at] = order[at - 1];
+      }
+      keys[at] = key;
+      order[at] = i;
+    }
+
+    bool split = false;
+    bool settled = true;
+    new_colors.resize(lines);
+    new_colors[order[0]] = 0;
+    for (int k = 1; k < lines; ++k) {
+      int a = order[k - 1];
+      int b = order[k];
+      if (keys[k - 1] != keys[k]) {
+        new_colors[b] = k;
+        split = split || colors[a] == colors[b];
+      } else {
+        new_colors[b] = new_colors[a];
+        settled = settled && identicalLines(by_rows, a, b);
+      }
+    }
+    colors.swap(new_colors);
+    (by_rows ? coloring.rows_settled : coloring.cols_settled) = settled;
+    return split;
+  }
+
+  // Refine until the colouring is stable, starting with rows if the column
+  // colours just changed, or columns if the row colours did. One axis only
+  // needs another pass after a cell of the other axis was split, and none
+  // once both axes are settled, which is where most flows end up (a
+  // splitter's two outputs are identical rows): then the pass that would only
+  // confirm nothing splits is skipped, and so is individualization.
+  void refine(Coloring& coloring, bool by_rows) {
+    while (refineLines(by_rows, coloring) && !(coloring.rows_settled && coloring.cols_settled)) {
+      by_rows = !by_rows;
+    }
+  }
+
+  // Find the first cell with more than one member, rows before columns.
+  // Returns false if every cell is a singleton.
+  bool targetCell(const Coloring& coloring, bool& by_rows, int& color) {
+    for (int axis = 0; axis < 2; ++axis) {
+      const vector<int>& colors = axis == 0 ? coloring.row_color : coloring.col_color;
+      cell_sizes.assign(colors.size(), 0);
+      for (int c : colors) {
+        ++cell_sizes[c];
+      }
+      for (int c = 0; c < colors.size(); ++c) {
+        if (cell_sizes[c] > 1) {
+          by_rows = axis == 0;
+          color = c;
+          return true;
+        }
+      }
+    }
+    return false;
+  }
+
+  // If every member of a cell is identical, any order of them gives the same
+  // leaves, so split the cell into singletons in index order without
+  // branching. That can't split cells of the other axis either, so no
+  // refinement is needed. Returns whether the cell was split.
+  bool splitTwinCell(Coloring& coloring, bool by_rows, int color) {
+    vector<int>& colors = by_rows ? coloring.row_color : coloring.col_color;
+
+    int first = -1;
+    for (int x = 0; x < colors.size(); ++x) {
+      if (colors[x] == color) {
+        if (first == -1) {
+          first = x;
+        } else if (!identicalLines(by_rows, first, x)) {
+          return false;
+        }
+      }
+    }
+
+    int next_color = color;
+    for (int x = 0; x < colors.size(); ++x) {
+      if (colors[x] == color) {
+        colors[x] = next_color++;
+      }
+    }
+    return true;
+  }
+
+  // Make every cell singletons, its members in index order
+  void splitInIndexOrder(vector<int>& colors) {
+    cell_sizes.assign(colors.size(), 0);
+    for (int& c : colors) {
+      int color = c;
+      c += cell_sizes[color]++;
+    }
+  }
+
+  // A leaf off the first path that equals the first leaf gives an
+  // automorphism fixing everything individualized above anchor, the deepest
+  // node the two paths share. It maps the first path's child of that node to
+  // this leaf's, so the rest of this subtree only repeats leaves already seen
+  // and the search backtracks to the anchor.
+  void leaf(const Coloring& coloring, int anchor) {
+    countSearchStat(&SearchCounters::labelings);
+    // The first leaf goes straight into best; later ones have to beat it
+    M& relabeled = found ? candidate : best;
+    relabeled.resize(rows, cols);
+    for (int i = 0; i < rows; ++i) {
+      for (int j = 0; j < cols; ++j) {
+        relabeled[coloring.row_color[i]][coloring.col_color[j]] = (*matrix)[i][j];
+      }
+    }
+
+    if (found) {
+      if (!(candidate < best)) {
+        if (candidate == (best_is_first ? best : first_leaf)) {
+          joinOrbits(coloring, anchor);
+          backtrack_to = anchor;
+        }
+        return;
+      }
+      if (best_is_first) {
+        swap(first_leaf, best);
+        swap(first_rows, best_rows);
+        swap(first_cols, best_cols);
+        best_is_first = false;
+      }
+      swap(best, candidate);
+    }
+    found = true;
+    best_rows.resize(rows);
+    for (int i = 0; i < rows; ++i) {
+      best_rows[coloring.row_color[i]] = i;
+    }
+    best_cols.resize(cols);
+    for (int j = 0; j < cols; ++j) {
+      best_cols[coloring.col_color[j]] = j;
+    }
+  }
+
+  int findOrbit(vector<int>& orbits, int x) {
+    while (orbits[x] != x) {
+      x = orbits[x] = orbits[orbits[x]];
+    }
+    return x;
+  }
+
+  // Join the orbits of every first path node down to anchor under the
+  // automorphism taking this leaf's lines to the first leaf's lines at the
+  // same positions
+  void joinOrbits(const Coloring& coloring, int anchor) {
+    for (int depth = 0; depth <= anchor; ++depth) {
+      Coloring& node = stack[depth];
+      bool by_rows = node.branch_by_rows;
+      const vector<int>& colors = by_rows ? coloring.row_color : coloring.col_color;
+      const vector<int>& first = by_rows ? (best_is_first ? best_rows : first_rows)
+                                         : (best_is_first ? best_cols : first_cols);
+      for (int x = 0; x < colors.size(); ++x) {
+        int a = findOrbit(node.orbits, x);
+        int b = findOrbit(node.orbits, first[colors[x]]);
+        node.orbits[max(a, b)] = min(a, b);
+      }
+    }
+  }
+
+  // Search the tree of individualizations below a refined colouring. The
+  // first path is the one to the first leaf; anchor is the deepest node on it
+  // above this one.
+  void search(int depth, bool on_first_path, int anchor) {
+    // A deque so that growing it doesn't move the colourings of outer calls
+    if (stack.size() < depth + 2) {
+      stack.resize(depth + 2);
+    }
+    Coloring& coloring = stack[depth];
+
+    // Only identical lines are still tied, so splitting their cells in index
+    // order reaches the leaf every order of them would
+    if (coloring.rows_settled && coloring.cols_settled) {
+      splitInIndexOrder(coloring.row_color);
+      splitInIndexOrder(coloring.col_color);
+      leaf(coloring, anchor);
+      return;
+    }
+
+    bool by_rows;
+    int color;
+    while (true) {
+      if (!targetCell(coloring, by_rows, color)) {
+        leaf(coloring, anchor);
+        return;
+      }
+      if (!splitTwinCell(coloring, by_rows, color)) {
+        break;
+      }
+    }
+
+    // Try each member of the cell first; identical members give the same
+    // leaves, and so do members an automorphism fixing this node maps onto
+    // each other
+    const vector<int>& colors = by_rows ? coloring.row_color : coloring.col_color;
+    coloring.tried.clear();
+    if (on_first_path) {
+      coloring.branch_by_rows = by_rows;
+      coloring.orbits.resize(colors.size());
+      iota(coloring.orbits.begin(), coloring.orbits.end(), 0);
+    }
+    for (int x = 0; x < colors.size(); ++x) {
+      if (colors[x] != color || any_of(coloring.tried.begin(), coloring.tried.end(), [&](int tried) {
+            return identicalLines(by_rows, x, tried) ||
+                   (on_first_path && findOrbit(coloring.orbits, x) == findOrbit(coloring.orbits, tried));
+          })) {
+        continue;
+      }
+      coloring.tried.push_back(x);
+
+      Coloring& child = stack[depth + 1];
+      child.row_color = coloring.row_color;
+      child.col_color = coloring.col_color;
+      child.rows_settled = by_rows ? false : coloring.rows_settled;
+      child.cols_settled = by_rows ? coloring.cols_settled : false;
+      vector<int>& child_colors = by_rows ? child.row_color : child.col_color;
+      for (int y = 0; y < child_colors.size(); ++y) {
+        if (y != x && child_colors[y] == color) {
+          child_colors[y] = color + 1;
+        }
+      }
+      refine(child, !by_rows);
+      bool first_child = coloring.tried.size() == 1;
+      search(depth + 1, on_first_path && first_child, on_first_path ? depth : anchor);
+      if (backtrack_to != -1) {
+        if (backtrack_to < depth) {
+          return;
+        }
+        backtrack_to = -1;
+      }
+    }
+  }
+
+  const M* matrix;
+  int rows;
+  int cols;
+  vector<uint64_t> value_hashes;
+  // By colour, shared by every call
+  vector<uint64_t> color_factors;
+
+  bool found;
+  M best;
+  M candidate;
+  // The first leaf, once a better one has replaced it as best
+  M first_leaf;
+  bool best_is_first;
+  // Depth of the node to resume the search at, or -1
+  int backtrack_to;
+  vector<int> best_rows;
+  vector<int> best_cols;
+  vector<int> first_rows;
+  vector<int> first_cols;
+
+  // Scratch space, kept between calls
+  deque<Coloring> stack;
+  vector<uint64_t> keys;
+  vector<int> order;
+  vector<int> new_colors;
+  vector<int> cell_sizes;
+};
+
+// Sort the rows of a matrix lexicographically
+template <class M>
+void sortRows(M& matrix) {
+  int rows = matrix.rows();
+  int cols = matrix.cols();
+
+  vector<int> order(rows);
+  iota(order.begin(), order.end(), 0);
+  sort(order.begin(), order.end(), [&](int a, int b) {
+    return lexicographical_compare(matrix[a], matrix[a] + cols, matrix[b], matrix[b] + cols);
+  });
+
+  M sorted(rows, cols);
+  for (int i = 0; i < rows; ++i) {
+    copy(matrix[order[i]], matrix[order[i]] + cols, sorted[i]);
+  }
+  matrix = move(sorted);
+}
+
+}  // namespace
+
+template <class M>
+M canonicalForm(const M& matrix, vector<int>* row_order, vector<int>* col_order) {
+  if (matrix.rows() == 0 || matrix.cols() == 0) {
+    if (row_order != nullptr) {
+      row_order->resize(matrix.rows());
+      iota(row_order->begin(), row_order->end(), 0);
+    }
+    if (col_order != nullptr) {
+      col_order->resize(matrix.cols());
+      iota(col_order->begin(), col_order->end(), 0);
+    }
+    return matrix;
+  }
+
+  static thread_local Canonizer<M> canonizer;
+  return canonizer.run(matrix, row_order, col_order);
+}
+
+template <class M>
+M sortNormalForm(M flow) {
+  // Keep sorting rows and columns until nothing further happens
+  bool sorted = false;
+  while (!sorted) {
+    M old_flow = flow;
+
+    sortRows(flow);
+    flow = transpose(flow);
+    sortRows(flow);
+    flow = transpose(flow);
+
+    if (flow == old_flow) {
+      sorted = true;
+    }
+  }
+
+  return flow;
+}
+
+template Matrix canonicalForm(const Matrix&, vector<int>*, vector<int>*);
+template ExactMatrix canonicalForm(const ExactMatrix&, vector<int>*, vector<int>*);
+template Matrix sortNormalForm(Matrix);
+template ExactMatrix sortNormalForm(ExactMatrix);
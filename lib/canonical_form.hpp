@@ -0,0 +1,26 @@
+// Canonical form of a flow matrix under row and column permutations
+
+#pragma once
+
+#include "types.hpp"
+
+// Reorder the rows and columns of a matrix into a canonical form: two matrices
+// get the same canonical form exactly when one is a row and column permutation
+// of the other. The form is the lexicographically smallest relabeling reachable
+// by colour refinement plus individualization of tied rows/columns, so flows
+// with tied rows or columns still get a unique representative. Once the only
+// ties left are between identical rows or columns, as for most flows, the
+// result is built straight away without individualizing, and subtrees that an
+// automorphism found on the way maps onto searched ones are skipped, so a
+// small flow costs less per call than sortNormalForm.
+//
+// If row_order/col_order are given, they receive which original row/column
+// ended up at each position of the result.
+template <class M>
+M canonicalForm(const M& matrix, vector<int>* row_order = nullptr, vector<int>* col_order = nullptr);
+
+// The old normal form: sort the rows, sort the columns, and repeat until
+// nothing changes. It isn't unique for matrices with tied rows or columns;
+// it's kept as a baseline for benchmarks.
+template <class M>
+M sortNormalForm(M matrix);
@@ -0,0 +1,272 @@
+// Saving and loading the state of a balancer search
+
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <type_traits>
+#include <unistd.h>
+
+#include "flow_runs.hpp"
+#include "checkpoint.hpp"
+
+namespace {
+
+const char checkpoint_magic[8] = {'B', 'A', 'L', 'S', 'R', 'C', 'H', 0};
+const uint32_t checkpoint_version = 2;
+
+enum ValueType : uint32_t { double_values = 0, rational_values = 1 };
+
+struct Header {
+  char magic[8];
+  uint32_t version;
+  uint32_t value_type;
+  int32_t input_size;
+  int32_t output_size;
+  int32_t max_num_splitters;
+  int32_t level;
+  // Options that change which flows are visited
+  uint32_t prune;
+  uint32_t padding;
+  CheckpointFlows flows;
+  uint64_t frontier;
+  uint64_t frontier_done;
+  uint64_t next_frontier;
+};
+
+string flowsPath(const string& path, uint64_t generation) {
+  return path + ".flows-" + to_string(generation);
+}
+
+template <class M>
+uint32_t valueType() {
+  return is_same<typename M::value_type, Rational>::value ? rational_values : double_values;
+}
+
+// A whole file mapped read-only into memory
+class MappedFile {
+ public:
+  explicit MappedFile(const string& path) {
+    int file = open(path.c_str(), O_RDONLY);
+    if (file == -1) {
+      throw "Can't open checkpoint";
+    }
+    struct stat status;
+    if (fstat(file, &status) != 0) {
+      ::close(file);
+      throw "Can't open checkpoint";
+    }
+    size = status.st_size;
+    if (size > 0) {
+      void* mapped = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, file, 0);
+      data = mapped == MAP_FAILED ? nullptr : (const char*)mapped;
+    }
+    ::close(file);
+    if (size > 0 && data == nullptr) {
+      throw "Can't map checkpoint";
+    }
+  }
+
+  ~MappedFile() {
+    if (data != nullptr) {
+      munmap((void*)data, size);
+    }
+  }
+
+  MappedFile(const MappedFile&) = delete;
+  MappedFile& operator=(const MappedFile&) = delete;
+
+  const char* data = nullptr;
+  size_t size = 0;
+};
+
+Header readHeader(const MappedFile& file) {
+  Header header;
+  if (file.size < sizeof(header)) {
+    throw "Not a checkpoint file";
+  }
+  memcpy(&header, file.data, sizeof(header));
+  if (memcmp(header.magic, checkpoint_magic, sizeof(checkpoint_magic)) != 0) {
+    throw "Not a checkpoint file";
+  }
+  if (header.version != checkpoint_version) {
+    throw "Unsupported checkpoint version";
+  }
+  return header;
+}
+
+// The header of the checkpoint at path, if there is one of this version
+bool tryReadHeader(const string& path, Header& header) {
+  FILE* file = fopen(path.c_str(), "rb");
+  if (file == nullptr) {
+    return false;
+  }
+  bool read = fread(&header, sizeof(header), 1, file) == 1;
+  fclose(file);
+  return read && memcmp(header.magic, checkpoint_magic, sizeof(checkpoint_magic)) == 0 &&
+         header.version == checkpoint_version;
+}
+
+void writeOrThrow(const void* data, size_t size, FILE* file) {
+  if (size > 0 && fwrite(data, size, 1, file) != 1) {
+    fclose(file);
+    throw "Can't write checkpoint";
+  }
+}
+
+void readIndices(const char*& data, const char* end, uint64_t count, vector<int>& indices) {
+  if ((size_t)(end - data) < count * sizeof(int32_t)) {
+    throw "Checkpoint is truncated";
+  }
+  indices.resize(count);
+  memcpy(indices.data(), data, count * sizeof(int32_t));
+  data += count * sizeof(int32_t);
+}
+
+}  // namespace
+
+template <class M>
+void saveCheckpoint(const string& path, SearchState<M>& state) {
+  static_assert(sizeof(int) == sizeof(int32_t), "Frontier indices are saved as int32s");
+
+  // Append to the flows file if the checkpoint at path is still the one this
+  // state was saved to or loaded from, else start a new generation
+  Header old_header;
+  bool exists = tryReadHeader(path, old_header);
+  const CheckpointFlows& saved = state.saved;
+  bool append = exists && state.saved_path == path && old_header.value_type == valueType<M>() &&
+                old_header.flows.generation == saved.generation && old_header.flows.flows == saved.flows &&
+                old_header.flows.bytes == saved.bytes && saved.flows <= state.visited.size();
+  CheckpointFlows flows;
+  flows.generation = append ? saved.generation : exists ? old_header.flows.generation + 1 : 1;
+  flows.flows = append ? saved.flows : 0;
+  flows.bytes = append ? saved.bytes : 0;
+
+  string flows_path = flowsPath(path, flows.generation);
+  FILE* flows_file = fopen(flows_path.c_str(), append ? "r+b" : "wb");
+  if (flows_file == nullptr) {
+    throw "Can't open checkpoint for writing";
+  }
+  // Drop anything a save that was killed part way appended
+  if (append && (ftruncate(fileno(flows_file), flows.bytes) != 0 || fseek(flows_file, flows.bytes, SEEK_SET) != 0)) {
+    fclose(flows_file);
+    throw "Can't write checkpoint";
+  }
+  string record;
+  for (; flows.flows < state.visited.size(); ++flows.flows) {
+    record.clear();
+    encodeFlow(state.visited[flows.flows], record);
+    writeOrThrow(record.data(), record.size(), flows_file);
+    flows.bytes += record.size();
+  }
+  bool failed = fflush(flows_file) != 0 || fsync(fileno(flows_file)) != 0;
+  if (fclose(flows_file) != 0 || failed) {
+    throw "Can't write checkpoint";
+  }
+
+  Header header = {};
+  memcpy(header.magic, checkpoint_magic, sizeof(checkpoint_magic));
+  header.version = checkpoint_version;
+  header.value_type = valueType<M>();
+  header.input_size = state.input_size;
+  header.output_size = state.output_size;
+  header.max_num_splitters = state.max_num_splitters;
+  header.level = state.level;
+  header.prune = state.prune;
+  header.flows = flows;
+  header.frontier = state.frontier.size();
+  header.frontier_done = state.frontier_done;
+  header.next_frontier = state.next_frontier.size();
+
+  string temporary_path = path + ".tmp";
+  FILE* file = fopen(temporary_path.c_str(), "wb");
+  if (file == nullptr) {
+    throw "Can't open checkpoint for writing";
+  }
+  writeOrThrow(&header, sizeof(header), file);
+  writeOrThrow(state.frontier.data(), state.frontier.size() * sizeof(int32_t), file);
+  writeOrThrow(state.next_frontier.data(), state.next_frontier.size() * sizeof(int32_t), file);
+
+  // On disk before it replaces the old checkpoint
+  failed = fflush(file) != 0 || fsync(fileno(file)) != 0;
+  failed = fclose(file) != 0 || failed;
+  if (failed || rename(temporary_path.c_str(), path.c_str()) != 0) {
+    throw "Can't write checkpoint";
+  }
+  if (exists && !append) {
+    remove(flowsPath(path, old_header.flows.generation).c_str());
+  }
+  state.saved_path = path;
+  state.saved = flows;
+}
+
+template <class M>
+void loadCheckpoint(const string& path, SearchState<M>& state) {
+  MappedFile file(path);
+  Header header = readHeader(file);
+  if (header.value_type != valueType<M>()) {
+    throw "Checkpoint has a different value type";
+  }
+
+  if (state.visited.size() != 0) {
+    throw "Checkpoint has to be loaded into a new search state";
+  }
+  state.input_size = header.input_size;
+  state.output_size = header.output_size;
+  state.max_num_splitters = header.max_num_splitters;
+  state.level = header.level;
+  state.prune = header.prune != 0;
+  state.frontier_done = header.frontier_done;
+
+  const char* data = file.data + sizeof(header);
+  const char* end = file.data + file.size;
+  readIndices(data, end, header.frontier, state.frontier);
+  readIndices(data, end, header.next_frontier, state.next_frontier);
+  if (data != end) {
+    throw "Checkpoint has trailing bytes";
+  }
+
+  // Bytes after the checkpoint's flows are from a save that didn't finish
+  MappedFile flows_file(flowsPath(path, header.flows.generation));
+  if (flows_file.size < header.flows.bytes) {
+    throw "Checkpoint is truncated";
+  }
+  data = flows_file.data;
+  end = flows_file.data + header.flows.bytes;
+  for (uint64_t i = 0; i < header.flows.flows; ++i) {
+    string_view rest(data, end - data);
+    size_t length = encodedFlowLength<M>(rest);
+    if (length > rest.size()) {
+      throw "Checkpoint is truncated";
+    }
+    if (!state.visited.insert(decodeFlow<M>(rest.substr(0, length)))) {
+      throw "Checkpoint has a repeated flow";
+    }
+    data += length;
+  }
+  if (data != end) {
+    throw "Checkpoint flows don't match their length";
+  }
+  for (const vector<int>* indices : {&state.frontier, &state.next_frontier}) {
+    for (int index : *indices) {
+      if (index < 0 || index >= state.visited.size()) {
+        throw "Checkpoint has a frontier flow that isn't stored";
+      }
+    }
+  }
+  state.saved_path = path;
+  state.saved = header.flows;
+}
+
+CheckpointInfo readCheckpointInfo(const string& path) {
+  MappedFile file(path);
+  Header header = readHeader(file);
+  return {header.input_size, header.output_size, header.max_num_splitters, header.level, header.prune != 0,
+          (size_t)header.flows.flows, (size_t)header.flows.bytes};
+}
+
+template void saveCheckpoint(const string&, SearchState<Matrix>&);
+template void saveCheckpoint(const string&, SearchState<ExactMatrix>&);
+template void loadCheckpoint(const string&, SearchState<Matrix>&);
+template void loadCheckpoint(const string&, SearchState<ExactMatrix>&);
@@ -0,0 +1,78 @@
+// Saving and loading the state of a balancer search
+
+#pragma once
+
+#include <cstdint>
+#include <string>
+
+#include "types.hpp"
+#include "flow_store.hpp"
+
+// Which flows file a checkpoint uses, and how many flows of it, in how many
+// bytes, belong to the checkpoint
+struct CheckpointFlows {
+  uint64_t generation = 0;
+  uint64_t flows = 0;
+  uint64_t bytes = 0;
+};
+
+// Everything existsBalancer needs to carry on with a search from between two
+// of its batches
+template <class M>
+struct SearchState {
+  int input_size = 0;
+  int output_size = 0;
+  int max_num_splitters = 0;
+  // Whether flows that can't lead to the balancer were dropped; the search
+  // can only carry on with the same setting
+  bool prune = false;
+  // Levels fully expanded, i.e. splitters placed
+  int level = 0;
+  // Every flow found so far
+  BasicFlowStore<M> visited;
+  // Indices (into visited) of the flows first found in the last full level
+  vector<int> frontier;
+  // How many frontier flows have been expanded, and the new flows they made
+  int frontier_done = 0;
+  vector<int> next_frontier;
+  // The checkpoint this state was last saved to or loaded from, if any, so
+  // saving there again only has to append the flows found since
+  string saved_path;
+  CheckpointFlows saved;
+};
+
+// What a checkpoint is of, without loading its flows
+struct CheckpointInfo {
+  int input_size;
+  int output_size;
+  int max_num_splitters;
+  int level;
+  bool prune;
+  size_t flows;
+  // Of the flows file
+  size_t flow_bytes;
+};
+
+// Write a search's state to path. A checkpoint is two files:
+// - path: a header with the search's sizes and options and the counts of what
+//   follows, then the frontier and next frontier as int32s;
+// - path + ".flows-" + the header's generation: every visited flow in
+//   insertion order, encoded as by encodeFlow. Only as many flows and bytes
+//   as the header says belong to the checkpoint.
+// Both are in native byte order (version 2). Visited flows are never removed,
+// so saving a state to the checkpoint it was last saved to or loaded from
+// only appends its new flows to the flows file. Any other save writes a new
+// generation. Either way path is written next to itself and renamed over
+// itself once the flows are on disk, so a search killed while saving leaves
+// the last checkpoint whole.
+template <class M>
+void saveCheckpoint(const string& path, SearchState<M>& state);
+
+// Read a checkpoint that saveCheckpoint wrote into a new state, by mapping it
+// into memory. The value type has to match: double for Matrix, Rational for
+// ExactMatrix.
+template <class M>
+void loadCheckpoint(const string& path, SearchState<M>& state);
+
+// Read just the header of a checkpoint
+CheckpointInfo readCheckpointInfo(const string& path);
@@ -0,0 +1,214 @@
+// Output ratios of a network that is edited one link at a time
+
+#include <algorithm>
+#include <type_traits>
+
+#include "network_tools.hpp"
+#include "utils.hpp"
+#include "dynamic_flow.hpp"
+
+namespace {
+
+// How small a double pivot or denominator can get, relative to the values it
+// was worked out from, before it counts as zero. A loop with no way out makes
+// it zero up to rounding error.
+const double tolerance = 1e-9;
+
+template <class T>
+T magnitude(T value) {
+  return value < T(0) ? T(0) - value : value;
+}
+
+template <class T>
+bool negligible(T value, T scale) {
+  if constexpr (is_same<T, double>::value) {
+    return magnitude(value) <= tolerance * scale;
+  } else {
+    return value == T(0);
+  }
+}
+
+}  // namespace
+
+template <class M>
+DynamicFlow<M>::DynamicFlow(Network network) : nodes(move(network)) {
+  for (int i = 0; i < nodes.size(); ++i) {
+    ids[nodes[i]] = i;
+  }
+  invert();
+}
+
+template <class M>
+void DynamicFlow<M>::invert() {
+  // Invert I - A by Gauss-Jordan elimination
+  int n = nodes.size();
+  M system = identityMatrix<M>(n);
+  for (int i = 0; i < n; ++i) {
+    for (auto& entry : row(i)) {
+      system[i][entry.first] -= entry.second;
+    }
+  }
+  M inverse = identityMatrix<M>(n);
+
+  // Pivots are compared to the largest row sum of I - A
+  T largest_row_sum = T(0);
+  for (int i = 0; i < n; ++i) {
+    T sum = T(0);
+    for (int j = 0; j < n; ++j) {
+      sum += magnitude(system[i][j]);
+    }
+    largest_row_sum = max(largest_row_sum, sum);
+  }
+
+  for (int col = 0; col < n; ++col) {
+    int pivot = col;
+    for (int r = col + 1; r < n; ++r) {
+      if (magnitude(system[pivot][col]) < magnitude(system[r][col])) {
+        pivot = r;
+      }
+    }
+    if (negligible(system[pivot][col], largest_row_sum)) {
+      throw "Network has a loop with no way out";
+    }
+    system.swapRows(col, pivot);
+    inverse.swapRows(col, pivot);
+
+    T scale = T(1) / system[col][col];
+    for (int j = 0; j < n; ++j) {
+      system[col][j] *= scale;
+      inverse[col][j] *= scale;
+    }
+    for (int r = 0; r < n; ++r) {
+      T factor = system[r][col];
+      if (r == col || factor == T(0)) {
+        continue;
+      }
+      for (int j = 0; j < n; ++j) {
+        system[r][j] -= factor * system[col][j];
+        inverse[r][j] -= factor * inverse[col][j];
+      }
+    }
+  }
+  transfer = move(inverse);
+  edits_since_inverted = 0;
+}
+
+template <class M>
+vector<pair<int, typename M::value_type>> DynamicFlow<M>::row(int node) const {
+  const Node* current_node = nodes[node];
+  T belt_normalizer = T(1) / T(max((int)current_node->outputs.size(), 1));
+
+  vector<pair<int, T>> coefficients;
+  for (const Node* input : current_node->inputs) {
+    coefficients.push_back({ids.at(input), belt_normalizer});
+  }
+  return coefficients;
+}
+
+template <class M>
+void DynamicFlow<M>::updateRow(M& inverse, int node, const vector<pair<int, T>>& change) const {
+  // (I - A - e_node c^T)^-1 = W + (W e_node)(c^T W) / (1 - c^T W e_node)
+  // Throws without changing inverse if the new I - A is singular.
+  int n = nodes.size();
+  vector<T> changed(n);
+  for (auto& entry : change) {
+    for (int j = 0; j < n; ++j) {
+      changed[j] += entry.second * inverse[entry.first][j];
+    }
+  }
+
+  T denominator = T(1) - changed[node];
+  if (negligible(denominator, T(1) + magnitude(changed[node]))) {
+    throw "Network has a loop with no way out";
+  }
+  for (T& value : changed) {
+    value /= denominator;
+  }
+
+  for (int i = 0; i < n; ++i) {
+    T weight = inverse[i][node];
+    if (weight == T(0)) {
+      continue;
+    }
+    for (int j = 0; j < n; ++j) {
+      inverse[i][j] += weight * changed[j];
+    }
+  }
+}
+
+template <class M>
+void DynamicFlow<M>::edit(int source, int target, bool add) {
+  vectorGuard(nodes, source);
+  vectorGuard(nodes, target);
+
+  // Only the rows of the two linked nodes change: the target gains or loses an
+  // input, and the source's inputs are spread over one more or one fewer output
+  vector<pair<int, T>> old_source = row(source);
+  vector<pair<int, T>> old_target = row(target);
+  if (add) {
+    link(nodes, source, target);
+  } else {
+    unlink(nodes, source, target);
+  }
+
+  auto difference = [](vector<pair<int, T>> new_row, const vector<pair<int, T>>& old_row) {
+    for (auto& entry : old_row) {
+      new_row.push_back({entry.first, T(0) - entry.second});
+    }
+    return new_row;
+  };
+
+  // updateRow throws before touching transfer, but the source row update may
+  // already have gone through when the target's throws, so keep W to go back to
+  M before = transfer;
+  try {
+    updateRow(transfer, source, difference(row(source), old_source));
+    if (target != source) {
+      updateRow(transfer, target, difference(row(target), old_target));
+    }
+    // Rounding error builds up with each update, so start again from the
+    // network every n edits, which costs as much as the n updates did
+    if (is_same<T, double>::value && edits_since_inverted + 1 >= nodes.size()) {
+      invert();
+    } else {
+      ++edits_since_inverted;
+    }
+  } catch (...) {
+    if (add) {
+      unlink(nodes, source, target);
+    } else {
+      link(nodes, source, target);
+    }
+    transfer = move(before);
+    throw;
+  }
+}
+
+template <class M>
+void DynamicFlow<M>::addLink(int source, int target) {
+  edit(source, target, true);
+}
+
+template <class M>
+void DynamicFlow<M>::removeLink(int source, int target) {
+  edit(source, target, false);
+}
+
+template <class M>
+M DynamicFlow<M>::flow() const {
+  // Only input nodes put flow in
+  int n = nodes.size();
+  M result(n, n);
+  for (int j = 0; j < n; ++j) {
+    if (!nodes[j]->inputs.empty()) {
+      continue;
+    }
+    for (int i = 0; i < n; ++i) {
+      result[i][j] = transfer[i][j];
+    }
+  }
+  return result;
+}
+
+template class DynamicFlow<Matrix>;
+template class DynamicFlow<ExactMatrix>;
@@ -0,0 +1,64 @@
+// Output ratios of a network that is edited one link at a time
+
+#pragma once
+
+#include <unordered_map>
+#include <utility>
+
+#include "types.hpp"
+
+// Keeps the output ratios of a network up to date while links are added and
+// removed. Each node's output is a fixed combination of its inputs' outputs,
+// x = A x + (input nodes), so the ratios come from (I - A)^-1. A link edit only
+// changes the rows of A for the two nodes it touches, and each row change is
+// applied to the stored inverse with a Sherman-Morrison update in O(n^2),
+// instead of solving the network again in O(n^3).
+//
+// With doubles, each update adds rounding error to the inverse, and a loop
+// with no way out only makes a pivot or update denominator zero up to
+// rounding. So those count as zero within a relative 1e-9, and the inverse is
+// worked out from scratch again every n edits, which keeps the error to that
+// of n updates at an amortized O(n^2) an edit.
+template <class M = Matrix>
+class DynamicFlow {
+ public:
+  using T = typename M::value_type;
+
+  // Takes over editing the network's links
+  explicit DynamicFlow(Network nodes);
+
+  // Link two nodes, like link() in network_tools
+  void addLink(int source, int target);
+
+  // Remove one link between two nodes
+  void removeLink(int source, int target);
+
+  const Network& network() const { return nodes; }
+
+  // The same matrix outputRatios(network()) gives
+  M flow() const;
+
+ private:
+  // A node's row of A as (column, coefficient) pairs: each input link adds
+  // 1 / (number of outputs). Columns can repeat.
+  vector<pair<int, T>> row(int node) const;
+
+  // Apply a link edit to the network and to transfer, or leave both as they
+  // were if the edit leaves a loop with no way out
+  void edit(int source, int target, bool add);
+
+  // Set transfer to (I - A)^-1 by Gauss-Jordan elimination
+  void invert();
+
+  // Add change to a node's row of A, updating an inverse to match
+  void updateRow(M& inverse, int node, const vector<pair<int, T>>& change) const;
+
+  Network nodes;
+  // Position of each node in nodes
+  unordered_map<const Node*, int> ids;
+  // (I - A)^-1: [i][j] is how much of node i's output comes from one unit of
+  // flow put in at node j
+  M transfer;
+  // Updates applied to transfer since it was last inverted from scratch
+  int edits_since_inverted = 0;
+};
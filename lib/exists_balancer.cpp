@@ -1,133 +1,856 @@
 // Computes the list of all flows possible with a certain number of splitters
 
 #include <algorithm>
-#include <set>
+#include <chrono>
+#include <cstdint>
+#include <filesystem>
+#include <string>
 #include <vector>
 #include <assert.h>
 
 #include "types.hpp"
 #include "network_tools.hpp"
+#include "canonical_form.hpp"
+#include "checkpoint.hpp"
+#include "flow_runs.hpp"
+#include "flow_store.hpp"
+#include "search_stats.hpp"
+#include "thread_pool.hpp"
+#include "utils.hpp"
 #include "exists_balancer.hpp"
 
 using namespace std;
 
-using Wiring = vector<int>;
-using Config = vector<Wiring>;
-using Configs = vector<Config>;
-
 Config unwired_2_1_splitter = {{-1, -1}, {-1}};
 
-void inline wire_2_inputs_1_fixedOutput(Configs &configs, int n){
-    for (int out = -1; out < n; ++out) {
-        configs.push_back({{-1, -1}, {out, -1}});
+// Bit j of masks[i] is set if flow output i depends on flow input j
+template <class M>
+vector<uint64_t> dependencyMasks(const M& flow) {
+    if (flow.cols() > 64) {
+        throw "Too many flow inputs for dependency masks";
+    }
+    vector<uint64_t> masks(flow.rows());
+    for (int i = 0; i < flow.rows(); ++i) {
+        for (int j = 0; j < flow.cols(); ++j) {
+            if (flow[i][j] != 0) {
+                masks[i] |= 1ull << j;
+            }
+        }
+    }
+    return masks;
+}
+
+// Add a config unless it's circular: every wired input only depends on flow
+// inputs that the splitter's own outputs feed, so the loop has no way out
+void inline addUnlessCircular(Configs &configs, const vector<uint64_t>& masks, Wiring inputs, Wiring outputs) {
+    // If there's a new input, we're fine
+    if (inputs[0] != -1) {
+        uint64_t depends_on = 0;
+        for (int in : inputs) {
+            depends_on |= masks[in];
+        }
+        uint64_t fed = 0;
+        for (int out : outputs) {
+            if (out != -1) {
+                fed |= 1ull << out;
+            }
+        }
+        if ((depends_on & ~fed) == 0) {
+            countSearchStat(&SearchCounters::circular);
+            return;
+        }
+    }
+    configs.push_back({move(inputs), move(outputs)});
+}
+
+void inline wire_2_inputs_1_fixedOutput(Configs &configs, const vector<uint64_t>& masks, const Wiring& outputs){
+    for (int out : outputs) {
+        addUnlessCircular(configs, masks, {-1, -1}, {out, -1});
     }
 }
 
-void inline wire_2_fixedInputs_1_output(Configs &configs, int in1, int in2, int n){
-    for (int out1 = -1; out1 < n; ++out1) {
-        configs.push_back({{in1, in2}, {out1, -1}});
+void inline wire_2_fixedInputs_1_output(Configs &configs, const vector<uint64_t>& masks, int in1, int in2, const Wiring& outputs){
+    for (int out1 : outputs) {
+        addUnlessCircular(configs, masks, {in1, in2}, {out1, -1});
     }
 }
 
-void inline wire_1_fixedInput_1_output(Configs &configs, int in1, int n){
-    for (int out1 = -1; out1 < n; ++out1) {
-        configs.push_back({{in1}, {out1, -1}});
+void inline wire_1_fixedInput_1_output(Configs &configs, const vector<uint64_t>& masks, int in1, const Wiring& outputs){
+    for (int out1 : outputs) {
+        addUnlessCircular(configs, masks, {in1}, {out1, -1});
     }
 }
 
-bool existsBalancer(int input_size, int output_size, int max_num_splitters) {
-    set<Matrix> possible_networks;
-    possible_networks.insert({{1}});
+// Rows (or columns) grouped by being identical. Swapping two identical lines
+// leaves the flow unchanged, so wiring a splitter to either of them gives the
+// same canonical flow.
+struct Twins {
+    // First line identical to each line
+    vector<int> first;
+    // How many identical lines come before each line
+    vector<int> rank;
+};
+
+template <class M>
+Twins findTwins(const M& flow, bool by_rows) {
+    int lines = by_rows ? flow.rows() : flow.cols();
+    int width = by_rows ? flow.cols() : flow.rows();
+    auto at = [&](int line, int k) { return by_rows ? flow[line][k] : flow[k][line]; };
+
+    Twins twins = {vector<int>(lines), vector<int>(lines, 0)};
+    for (int i = 0; i < lines; ++i) {
+        twins.first[i] = i;
+        for (int j = i - 1; j >= 0; --j) {
+            bool identical = true;
+            for (int k = 0; k < width && identical; ++k) {
+                identical = at(i, k) == at(j, k);
+            }
+            if (identical) {
+                twins.first[i] = twins.first[j];
+                twins.rank[i] = twins.rank[j] + 1;
+                break;
+            }
+        }
+    }
+    return twins;
+}
+
+template <class M>
+Configs validConfigs(const M& flow) {
+    vector<Config> valid_configs;
     
-    // Note: I assume out1 and out2 aren't both looped back to inputs; check to see if this is valid later
-    for (int i = 0; i < max_num_splitters; ++i) {
-        set<Matrix> new_possible_networks;
+    int n = flow.rows();
+    int m = flow.cols();
+
+    // Circular dependencies are dropped as the configs are generated
+    vector<uint64_t> masks = dependencyMasks(flow);
+
+    // Only one wiring per orbit under swaps of identical rows and columns: a
+    // flow output is wired only if no identical output comes before it, or
+    // as the second input next to the first of two identical outputs; a
+    // flow input only if no identical input comes before it
+    Twins row_twins = findTwins(flow, true);
+    Twins col_twins = findTwins(flow, false);
+    Wiring outputs = {-1};
+    for (int out = 0; out < m; ++out) {
+        if (col_twins.rank[out] == 0) {
+            outputs.push_back(out);
+        }
+    }
+
+    // Add trivial unwired 2-1 splitter
+    valid_configs.push_back(unwired_2_1_splitter);
+
+    // Add 2-2 splitter with 1 wired output
+    wire_2_inputs_1_fixedOutput(valid_configs, masks, outputs);
+    
+    for (int in1 = -1; in1 < n; ++in1) {
+        if (in1 != -1 && row_twins.rank[in1] != 0) {
+            continue;
+        }
+
+        // Cases with one wired input
+        addUnlessCircular(valid_configs, masks, {in1}, {-1});
+        wire_1_fixedInput_1_output(valid_configs, masks, in1, outputs);
         
-        // Expand on each possible network
-        // Need to do this in a way so that there are no "infinite loops"
-        for (auto it = possible_networks.begin(); it != possible_networks.end(); ++it) {
-            vector<Config> valid_configs;
-            
-            int n = (int)it->size();
-            int m = (int)(*it)[0].size();
-
-            // Add trivial unwired 2-1 splitter
-            valid_configs.push_back(unwired_2_1_splitter);
-
-            // Add 2-2 splitter with 1 wired output
-            wire_2_inputs_1_fixedOutput(valid_configs, m);
-            
-            for (int in1 = -1; in1 < (int)it->size(); ++in1) {
-                // Cases with one wired input
-                valid_configs.push_back({{in1}, {-1}});
-                wire_1_fixedInput_1_output(valid_configs, in1, m);
-                
-                // Cases with two wired inputs.. 
-                for (int in2 = in1 + 1; in2 < n; ++in2) {
-                    // .. And one unwired output
-                    valid_configs.push_back({{in1, in2}, {-1}});
-
-                    // .. Or one wired output
-                    wire_2_fixedInputs_1_output(valid_configs, in1, in2, m);
+        // Cases with two wired inputs.. 
+        for (int in2 = in1 + 1; in2 < n; ++in2) {
+            bool second_twin = row_twins.rank[in2] == 1 && row_twins.first[in2] == in1;
+            if (row_twins.rank[in2] != 0 && !second_twin) {
+                continue;
+            }
+
+            // .. And one unwired output
+            addUnlessCircular(valid_configs, masks, {in1, in2}, {-1});
+
+            // .. Or one wired output
+            wire_2_fixedInputs_1_output(valid_configs, masks, in1, in2, outputs);
+        }
+    }
+
+    return valid_configs;
+}
+
+// Frontier flows expanded per parallelFor, per thread. Children are buffered
+// until the whole batch is merged, so this bounds the memory they take.
+static const int batch_per_thread = 64;
+
+// Each splitter changes a flow's outputs (rows) and inputs (columns) by at
+// least -1 and at most +2
+static const int most_lost_per_splitter = 1;
+static const int most_gained_per_splitter = 2;
+
+// Whether a flow with this many rows/columns could still have target of them
+// after at most splitters_left more splitters
+inline bool canReach(int size, int target, int splitters_left) {
+    return size - most_lost_per_splitter * splitters_left <= target &&
+           size + most_gained_per_splitter * splitters_left >= target;
+}
+
+// Shape of the flow a config makes, without building it
+inline void configResultSize(int rows, int cols, const Config& config, int& new_rows, int& new_cols) {
+    new_rows = rows;
+    new_cols = cols;
+    // A new input adds a column, a wired one uses up an output
+    for (int in : config[0]) {
+        if (in == -1) {
+            ++new_cols;
+        } else {
+            --new_rows;
+        }
+    }
+    // A new output adds a row, a wired one uses up an input
+    for (int out : config[1]) {
+        if (out == -1) {
+            ++new_rows;
+        } else {
+            --new_cols;
+        }
+    }
+}
+
+// The goal of existsBalancer: one balancer, which only stops the search early
+// when pruning
+template <class M>
+struct BalancerGoal {
+    M balancer;
+    bool prune;
+    // If given, gets where each new flow came from, by visited index
+    vector<FlowParent>* parents;
+
+    bool reachable(int rows, int cols, int splitters_left) const {
+        return canReach(rows, balancer.rows(), splitters_left) && canReach(cols, balancer.cols(), splitters_left);
+    }
+
+    bool found(const M& new_flow, FlowParent made_from, int) {
+        if (parents != nullptr) {
+            parents->push_back(made_from);
+        }
+        return prune && new_flow == balancer;
+    }
+};
+
+// Make every flow one more splitter can turn flow into, and pass each one to
+// keep with the index of the config (in validConfigs(flow)) that made it. With
+// prune, configs making a shape that goal.reachable rules out are skipped.
+// Counts into stats, which should be the calling thread's.
+template <class M, class Goal, class Keep>
+static void expandFlow(const M& flow, bool prune, int splitters_left, const Goal& goal, LevelStats& stats,
+                       Keep keep) {
+    SearchCounters counted_before;
+    if constexpr (search_stats_enabled) {
+        counted_before = threadSearchCounters();
+    }
+
+    Configs valid_configs = validConfigs(flow);
+    for (int j = 0; j < valid_configs.size(); ++j) {
+        // Skip flows that can't be turned into a target with the splitters left
+        if (prune) {
+            int new_rows, new_cols;
+            configResultSize(flow.rows(), flow.cols(), valid_configs[j], new_rows, new_cols);
+            if (!goal.reachable(new_rows, new_cols, splitters_left)) {
+                if constexpr (search_stats_enabled) {
+                    ++stats.pruned;
                 }
+                continue;
             }
-            
-            // Drop circular dependencies
-            for (int j = valid_configs.size() - 1; j >= 0; --j) {
-                // If there's a new input, we're fine
-                if (valid_configs[j][0][0] == -1) {
-                    continue;
+        }
+        keep(addSplitterToFlow(flow, valid_configs[j][0], valid_configs[j][1]), j);
+    }
+
+    if constexpr (search_stats_enabled) {
+        stats.configs += valid_configs.size();
+        stats.counters += threadSearchCounters() - counted_before;
+    }
+}
+
+// existsBalancer with its flows on disk. Each level streams the frontier from
+// its run file, spills the children as sorted runs, and merges those with the
+// sorted file of every flow visited so far; children that aren't in it make
+// up the next frontier.
+template <class M>
+static bool spillingSearch(int input_size, int output_size, int max_num_splitters, FlowStoreStats* visited_stats,
+                           SearchOptions options) {
+    using T = typename M::value_type;
+
+    SpillDirectory directory(options.spill_directory);
+    BalancerGoal<M> goal = {M(output_size, input_size, T(1) / T(output_size)), options.prune, nullptr};
+    string balancer;
+    encodeFlow(goal.balancer, balancer);
+
+    // Every flow found so far, and the ones first found in the previous level, both sorted
+    string visited_path = directory.path("visited-0");
+    string frontier_path = directory.path("frontier-0");
+    size_t visited_count = 1;
+    size_t frontier_count = 1;
+    string record;
+    encodeFlow(M({{1}}), record);
+    for (const string& path : {visited_path, frontier_path}) {
+        RunWriter run(path);
+        run.write(record);
+        run.close();
+    }
+    bool found = record == balancer;
+
+    auto finish = [&](bool result) {
+        if (visited_stats != nullptr) {
+            *visited_stats = {visited_count, 0, 0, 0, 0, (size_t)filesystem::file_size(visited_path)};
+        }
+        return result;
+    };
+    if (options.prune && found) {
+        return finish(true);
+    }
+
+    ThreadPool pool(options.threads);
+    const int batch_size = batch_per_thread * pool.threads();
+    auto started = chrono::steady_clock::now();
+
+    // What each level did, and each thread's part of it
+    LevelStats level_stats;
+    vector<LevelStats> thread_stats(pool.threads());
+    auto level_started = started;
+    auto add_level_stats = [&](int level) {
+        if (options.stats != nullptr) {
+            for (LevelStats& part : thread_stats) {
+                level_stats += part;
+                part = LevelStats();
+            }
+            level_stats.level = level;
+            level_stats.seconds = chrono::duration<double>(chrono::steady_clock::now() - level_started).count();
+            options.stats->levels.push_back(level_stats);
+        }
+    };
+
+    for (int i = 0; i < max_num_splitters && frontier_count > 0; ++i) {
+        int splitters_left = max_num_splitters - i - 1;
+        string level = to_string(i + 1);
+        level_stats = LevelStats();
+        level_started = chrono::steady_clock::now();
+        // Children written out, duplicates included
+        size_t children_count = 0;
+
+        RunBuffer children_runs(directory.path("children-" + level + "-"), options.memory_limit);
+        {
+            RunReader frontier(frontier_path);
+            vector<M> batch;
+            bool more = true;
+            while (more) {
+                batch.clear();
+                while (batch.size() < batch_size && (more = frontier.next(record))) {
+                    batch.push_back(decodeFlow<M>(record));
                 }
-                
-                bool circular = true;
-                for (int k = 0; k < valid_configs[j][0].size(); ++k) {
-                    // Check if this input is non-circular
-                    for (int l = 0; l < (*it)[0].size(); ++l) {
-                        // Check that this isn't a new output of the splitter
-                        bool true_input = true;
-                        for (int m = 0; m < valid_configs[j][1].size(); ++m) {
-                            if (l == valid_configs[j][1][m]) {
-                                true_input = false;
-                            }
-                        }
-                        
-                        if (true_input == true && (*it)[valid_configs[j][0][k]][l] != 0) {
-                            circular = false;
+
+                // New flows found from each network in the batch, in config order
+                vector<vector<M>> children(batch.size());
+                pool.parallelFor(batch.size(), [&](int thread, int k) {
+                    expandFlow(batch[k], options.prune, splitters_left, goal, thread_stats[thread],
+                               [&](M new_flow, int) { children[k].push_back(move(new_flow)); });
+                });
+                level_stats.expanded += batch.size();
+
+                for (const vector<M>& flows : children) {
+                    for (const M& new_flow : flows) {
+                        record.clear();
+                        encodeFlow(new_flow, record);
+                        if (options.prune && record == balancer) {
+                            add_level_stats(i + 1);
+                            return finish(true);
                         }
+                        children_runs.add(record);
+                        ++children_count;
                     }
                 }
-                
-                if (circular) {
-                    valid_configs.erase(valid_configs.begin() + j);
+            }
+        }
+
+        // Merge the children into the visited flows; the ones that weren't there are the next frontier
+        string next_visited_path = directory.path("visited-" + level);
+        string next_frontier_path = directory.path("frontier-" + level);
+        vector<string> runs = children_runs.finish();
+        {
+            RunMerger children(runs);
+            RunReader visited(visited_path);
+            RunWriter next_visited(next_visited_path);
+            RunWriter next_frontier(next_frontier_path);
+            string seen;
+            bool more_seen = visited.next(seen);
+            while (children.next(record)) {
+                while (more_seen && seen < record) {
+                    next_visited.write(seen);
+                    more_seen = visited.next(seen);
                 }
+                if (more_seen && seen == record) {
+                    continue;
+                }
+                next_visited.write(record);
+                next_frontier.write(record);
+                found = found || record == balancer;
             }
-            
-            for (int j = 0; j < valid_configs.size(); ++j) {
-                new_possible_networks.insert(addSplitterToFlow(*it, valid_configs[j][0], valid_configs[j][1]));
+            while (more_seen) {
+                next_visited.write(seen);
+                more_seen = visited.next(seen);
             }
+            next_visited.close();
+            next_frontier.close();
+            visited_count = next_visited.records();
+            frontier_count = next_frontier.records();
         }
-        
-        for (auto it = new_possible_networks.begin(); it != new_possible_networks.end(); ++it) {
-            possible_networks.insert(*it);
+        level_stats.new_flows = frontier_count;
+        if constexpr (search_stats_enabled) {
+            level_stats.duplicates += children_count - frontier_count;
+        }
+        add_level_stats(i + 1);
+
+        for (const string& path : runs) {
+            filesystem::remove(path);
+        }
+        filesystem::remove(visited_path);
+        filesystem::remove(frontier_path);
+        visited_path = next_visited_path;
+        frontier_path = next_frontier_path;
+
+        if (options.progress) {
+            chrono::duration<double> seconds = chrono::steady_clock::now() - started;
+            options.progress({i + 1, max_num_splitters, visited_count, frontier_count, 0, seconds.count()});
         }
     }
-    
+
+    return finish(found);
+}
+
+// Expand a search state level by level, saving it to options.checkpoint_path
+// as it goes, until it has max_num_splitters levels, runs out of new flows, or
+// goal asks to stop. Returns whether goal stopped it. Goal has
+//   bool reachable(int rows, int cols, int splitters_left) const;
+// which, with options.prune, drops flows of a shape that can't lead anywhere
+// useful with the splitters left (called from every thread), and
+//   bool found(const M& new_flow, FlowParent made_from, int level);
+// which sees each new flow once, in order, and returns true to stop. If
+// level_ends is given, visited's size is added to it at the end of each level.
+template <class M, class Goal>
+static bool expandLevels(SearchState<M>& state, const SearchOptions& options, Goal& goal,
+                         vector<size_t>* level_ends = nullptr) {
+    // Every flow found so far, for dedup
+    BasicFlowStore<M>& visited = state.visited;
+    // Indices (into visited) of flows first found in the previous level; only these still need expanding
+    vector<int>& frontier = state.frontier;
+    vector<int>& next_frontier = state.next_frontier;
+    const int max_num_splitters = state.max_num_splitters;
+
+    ThreadPool pool(options.threads);
+    const int batch_size = batch_per_thread * pool.threads();
+
+    auto started = chrono::steady_clock::now();
+    auto last_saved = started;
+    auto last_progress = started;
+    auto save = [&]() {
+        if (!options.checkpoint_path.empty()) {
+            saveCheckpoint(options.checkpoint_path, state);
+            last_saved = chrono::steady_clock::now();
+        }
+    };
+    auto progress = [&]() {
+        if (options.progress) {
+            last_progress = chrono::steady_clock::now();
+            chrono::duration<double> seconds = last_progress - started;
+            options.progress({state.level, max_num_splitters, (size_t)visited.size(), frontier.size(),
+                              (size_t)state.frontier_done, seconds.count()});
+        }
+    };
+
+    // What this level did, and each thread's part of it
+    LevelStats level_stats;
+    vector<LevelStats> thread_stats(pool.threads());
+    auto level_started = started;
+    auto add_level_stats = [&]() {
+        if (options.stats != nullptr) {
+            for (LevelStats& part : thread_stats) {
+                level_stats += part;
+                part = LevelStats();
+            }
+            level_stats.level = state.level + 1;
+            level_stats.seconds = chrono::duration<double>(chrono::steady_clock::now() - level_started).count();
+            options.stats->levels.push_back(level_stats);
+        }
+    };
+
+    // Note: I assume out1 and out2 aren't both looped back to inputs; check to see if this is valid later
+    while (state.level < max_num_splitters && !frontier.empty()) {
+        int splitters_left = max_num_splitters - state.level - 1;
+        level_stats = LevelStats();
+        level_started = chrono::steady_clock::now();
+
+        for (int begin = state.frontier_done; begin < frontier.size(); begin += batch_size) {
+            int count = min(batch_size, (int)frontier.size() - begin);
+            // New flows found from each network in the batch, in config order,
+            // with the index of the config that made each one
+            vector<vector<pair<M, int>>> children(count);
+
+            // Expand on each network found last level. visited isn't written
+            // to until the batch is done, so workers can look flows up in it
+            // and only keep the ones that are new.
+            // Need to do this in a way so that there are no "infinite loops"
+            pool.parallelFor(count, [&](int thread, int k) {
+                expandFlow(visited[frontier[begin + k]], options.prune, splitters_left, goal, thread_stats[thread],
+                           [&](M new_flow, int config) {
+                               if (!visited.contains(new_flow)) {
+                                   children[k].emplace_back(move(new_flow), config);
+                               } else if constexpr (search_stats_enabled) {
+                                   ++thread_stats[thread].duplicates;
+                               }
+                           });
+            });
+            level_stats.expanded += count;
+
+            // Merge in frontier order, so the flows visited and their indices
+            // are the same however many threads there are
+            for (int k = 0; k < count; ++k) {
+                for (const pair<M, int>& child : children[k]) {
+                    const M& new_flow = child.first;
+                    if (visited.insert(new_flow)) {
+                        ++level_stats.new_flows;
+                        if (goal.found(new_flow, {frontier[begin + k], child.second}, state.level + 1)) {
+                            add_level_stats();
+                            return true;
+                        }
+                        next_frontier.push_back(visited.size() - 1);
+                    } else if constexpr (search_stats_enabled) {
+                        ++level_stats.duplicates;
+                    }
+                }
+            }
+
+            // The state is whole between batches, so a long level can be saved part way
+            state.frontier_done = begin + count;
+            if (options.checkpoint_seconds > 0 &&
+                chrono::steady_clock::now() - last_saved >= chrono::duration<double>(options.checkpoint_seconds)) {
+                save();
+            }
+            if (options.progress_seconds > 0 &&
+                chrono::steady_clock::now() - last_progress >= chrono::duration<double>(options.progress_seconds)) {
+                progress();
+            }
+        }
+
+        add_level_stats();
+        frontier = move(next_frontier);
+        next_frontier.clear();
+        state.frontier_done = 0;
+        ++state.level;
+        if (level_ends != nullptr) {
+            level_ends->push_back(visited.size());
+        }
+        progress();
+        save();
+    }
+    return false;
+}
+
+// Carry on with an existsBalancer search from its state. parents, if given,
+// has to have an entry for every flow visited so far.
+template <class M>
+static bool runSearch(SearchState<M>& state, FlowStoreStats* visited_stats, SearchOptions options,
+                      vector<FlowParent>* parents = nullptr) {
+    using T = typename M::value_type;
+
+    // The balancer we're looking for
+    BalancerGoal<M> goal = {M(state.output_size, state.input_size, T(1) / T(state.output_size)), options.prune,
+                            parents};
+
+    auto finish = [&](bool found) {
+        if (visited_stats != nullptr) {
+            *visited_stats = state.visited.stats();
+        }
+        return found;
+    };
+    if (options.prune && state.visited.contains(goal.balancer)) {
+        return finish(true);
+    }
+    if (expandLevels(state, options, goal)) {
+        return finish(true);
+    }
+
     // Check if it's a splitter
-    Row balanced_output;
-    for (int i = 0; i < input_size; ++i) {
-        balanced_output.push_back(1.0 / output_size);
+    return finish(state.visited.contains(goal.balancer));
+}
+
+// The goal of minBalancerSplitters: every balancer up to a size, indexed by
+// its shape. Stops once all of them are found.
+template <class M>
+struct SweepGoal {
+    int max_size;
+    // [in - 1][out - 1], -1 until found
+    vector<vector<int>> splitters;
+    int remaining;
+
+    bool reachable(int rows, int cols, int splitters_left) const {
+        for (int in = 1; in <= max_size; ++in) {
+            if (!canReach(cols, in, splitters_left)) {
+                continue;
+            }
+            for (int out = 1; out <= max_size; ++out) {
+                if (splitters[in - 1][out - 1] == -1 && canReach(rows, out, splitters_left)) {
+                    return true;
+                }
+            }
+        }
+        return false;
     }
-    Matrix balancer;
-    for (int i = 0; i < output_size; ++i) {
-        balancer.push_back(balanced_output);
+
+    bool found(const M& new_flow, FlowParent, int level) {
+        int in = new_flow.cols();
+        int out = new_flow.rows();
+        if (in <= max_size && out <= max_size && splitters[in - 1][out - 1] == -1 && isBalancer(new_flow)) {
+            splitters[in - 1][out - 1] = level;
+            --remaining;
+        }
+        return remaining == 0;
     }
-    
-    // it_num is for debugging purposes
-    int it_num = 0;
-    for (auto it = possible_networks.begin(); it != possible_networks.end(); ++it, ++it_num) {
-        if (*it == balancer) {
-            return true;
+};
+
+template <class M>
+static vector<vector<int>> sweepBalancers(int max_size, int max_num_splitters, SearchOptions options) {
+    SweepGoal<M> goal = {max_size, vector<vector<int>>(max_size, vector<int>(max_size, -1)), max_size * max_size};
+    SearchState<M> state;
+    state.input_size = 1;
+    state.output_size = 1;
+    state.max_num_splitters = max_num_splitters;
+    state.visited.insert({{1}});
+    state.frontier.push_back(0);
+    if (!goal.found(state.visited[0], {-1, -1}, 0)) {
+        expandLevels(state, options, goal);
+    }
+    return goal.splitters;
+}
+
+template <class M>
+static bool searchBalancer(int input_size, int output_size, int max_num_splitters, FlowStoreStats* visited_stats,
+                           SearchOptions options) {
+    if (options.memory_limit > 0) {
+        if (!options.checkpoint_path.empty()) {
+            throw "Checkpoints aren't supported with memory_limit";
         }
+        return spillingSearch<M>(input_size, output_size, max_num_splitters, visited_stats, options);
     }
-    return false;
+
+    SearchState<M> state;
+    state.input_size = input_size;
+    state.output_size = output_size;
+    state.max_num_splitters = max_num_splitters;
+    state.prune = options.prune;
+    state.visited.insert({{1}});
+    state.frontier.push_back(0);
+    return runSearch(state, visited_stats, options);
+}
+
+template <class M>
+static bool resumeSearch(const string& checkpoint_path, FlowStoreStats* visited_stats, SearchOptions options) {
+    SearchState<M> state;
+    loadCheckpoint(checkpoint_path, state);
+    if (state.prune != options.prune) {
+        throw "Checkpoint was saved with a different prune option";
+    }
+    return runSearch(state, visited_stats, options);
+}
+
+template <class M>
+OwnedNetwork witnessNetwork(const BasicFlowStore<M>& visited, const vector<FlowParent>& parents, int index) {
+    // The flows from {{1}} to this one
+    vector<int> chain = {index};
+    while (parents[chain.back()].parent != -1) {
+        chain.push_back(parents[chain.back()].parent);
+    }
+    reverse(chain.begin(), chain.end());
+
+    // Node 0 passes the one belt of {{1}} through. Each step adds a splitter
+    // node; producer[i] is the node flow output i comes out of, and
+    // consumer[j] the node flow input j goes into.
+    int num_nodes = 1;
+    vector<pair<int, int>> links;
+    vector<int> producer = {0};
+    vector<int> consumer = {0};
+    for (int step = 1; step < chain.size(); ++step) {
+        M flow = visited[chain[step - 1]];
+        Config config = validConfigs(flow)[parents[chain[step]].config];
+        int splitter = num_nodes++;
+
+        // Outputs and inputs in attachSplitter's order: the old ones left,
+        // then the splitter's new ones
+        vector<int> producers, consumers;
+        vector<bool> used_output(flow.rows()), used_input(flow.cols());
+        for (int in : config[0]) {
+            if (in != -1) {
+                links.push_back({producer[in], splitter});
+                used_output[in] = true;
+            }
+        }
+        for (int out : config[1]) {
+            if (out != -1) {
+                links.push_back({splitter, consumer[out]});
+                used_input[out] = true;
+            }
+        }
+        for (int i = 0; i < flow.rows(); ++i) {
+            if (!used_output[i]) {
+                producers.push_back(producer[i]);
+            }
+        }
+        for (int out : config[1]) {
+            if (out == -1) {
+                producers.push_back(splitter);
+            }
+        }
+        for (int j = 0; j < flow.cols(); ++j) {
+            if (!used_input[j]) {
+                consumers.push_back(consumer[j]);
+            }
+        }
+        for (int in : config[0]) {
+            if (in == -1) {
+                consumers.push_back(splitter);
+            }
+        }
+
+        // The stored flow is the canonical form, with its rows and columns reordered
+        vector<int> row_order, col_order;
+        canonicalForm(attachSplitter(flow, config[0], config[1]), &row_order, &col_order);
+        producer.resize(row_order.size());
+        consumer.resize(col_order.size());
+        for (int i = 0; i < row_order.size(); ++i) {
+            producer[i] = producers[row_order[i]];
+        }
+        for (int j = 0; j < col_order.size(); ++j) {
+            consumer[j] = consumers[col_order[j]];
+        }
+    }
+
+    // A node for each belt in and out
+    int num_inputs = consumer.size();
+    int num_outputs = producer.size();
+    OwnedNetwork network(num_nodes + num_inputs + num_outputs);
+    for (int j = 0; j < num_inputs; ++j) {
+        link(network, num_nodes + j, consumer[j]);
+    }
+    for (const pair<int, int>& node_link : links) {
+        link(network, node_link.first, node_link.second);
+    }
+    for (int i = 0; i < num_outputs; ++i) {
+        link(network, producer[i], num_nodes + num_inputs + i);
+    }
+    return network;
+}
+
+template <class M>
+bool findBalancer(int input_size, int output_size, int max_num_splitters, OwnedNetwork* balancer,
+                  FlowStoreStats* visited_stats, SearchOptions options) {
+    if (options.memory_limit > 0 || !options.checkpoint_path.empty()) {
+        throw "Finding a balancer doesn't support memory_limit or checkpoints";
+    }
+
+    SearchState<M> state;
+    state.input_size = input_size;
+    state.output_size = output_size;
+    state.max_num_splitters = max_num_splitters;
+    state.visited.insert({{1}});
+    state.frontier.push_back(0);
+    vector<FlowParent> parents = {{-1, -1}};
+    if (!runSearch(state, visited_stats, options, &parents)) {
+        return false;
+    }
+
+    using T = typename M::value_type;
+    if (balancer != nullptr) {
+        int index = state.visited.find(M(output_size, input_size, T(1) / T(output_size)));
+        *balancer = witnessNetwork(state.visited, parents, index);
+    }
+    return true;
 }
+
+template <class M>
+bool isBalancer(const M& flow) {
+    using T = typename M::value_type;
+    T share = T(1) / T(flow.rows());
+    for (int i = 0; i < flow.rows(); ++i) {
+        for (int j = 0; j < flow.cols(); ++j) {
+            if (flow[i][j] != share) {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+// The goal of expandSearch: every flow, so none are dropped and nothing stops
+// the search
+template <class M>
+struct EveryFlowGoal {
+    bool reachable(int, int, int) const {
+        return true;
+    }
+
+    bool found(const M&, FlowParent, int) {
+        return false;
+    }
+};
+
+template <class M>
+void expandSearch(SearchState<M>& state, int max_num_splitters, SearchOptions options, vector<size_t>* level_ends) {
+    options.prune = false;
+    state.max_num_splitters = max(state.max_num_splitters, max_num_splitters);
+    EveryFlowGoal<M> goal;
+    expandLevels(state, options, goal, level_ends);
+}
+
+void logProgress(const SearchProgress& progress) {
+    string line = "level " + to_string(progress.level) + "/" + to_string(progress.max_num_splitters) + ": " +
+                  to_string(progress.visited) + " visited, ";
+    if (progress.frontier_done > 0) {
+        line += to_string(progress.frontier_done) + "/" + to_string(progress.frontier) + " of the frontier expanded, ";
+    } else {
+        line += to_string(progress.frontier) + " in the frontier, ";
+    }
+    log(line + to_string(progress.seconds) + " s");
+}
+
+template <class M>
+bool existsBalancer(int input_size, int output_size, int max_num_splitters, FlowStoreStats* visited_stats,
+                    SearchOptions options) {
+    return searchBalancer<M>(input_size, output_size, max_num_splitters, visited_stats, options);
+}
+
+template <class M>
+bool resumeBalancer(const string& checkpoint_path, FlowStoreStats* visited_stats, SearchOptions options) {
+    if (options.memory_limit > 0) {
+        throw "Checkpoints aren't supported with memory_limit";
+    }
+    if (options.checkpoint_path.empty()) {
+        options.checkpoint_path = checkpoint_path;
+    }
+    return resumeSearch<M>(checkpoint_path, visited_stats, options);
+}
+
+template <class M>
+vector<vector<int>> minBalancerSplitters(int max_size, int max_num_splitters, SearchOptions options) {
+    if (options.memory_limit > 0 || !options.checkpoint_path.empty()) {
+        throw "Sweeps don't support memory_limit or checkpoints";
+    }
+    return sweepBalancers<M>(max_size, max_num_splitters, options);
+}
+
+template Configs validConfigs(const Matrix&);
+template Configs validConfigs(const ExactMatrix&);
+template bool existsBalancer<Matrix>(int, int, int, FlowStoreStats*, SearchOptions);
+template bool existsBalancer<ExactMatrix>(int, int, int, FlowStoreStats*, SearchOptions);
+template bool resumeBalancer<Matrix>(const string&, FlowStoreStats*, SearchOptions);
+template bool resumeBalancer<ExactMatrix>(const string&, FlowStoreStats*, SearchOptions);
+template OwnedNetwork witnessNetwork(const BasicFlowStore<Matrix>&, const vector<FlowParent>&, int);
+template OwnedNetwork witnessNetwork(const BasicFlowStore<ExactMatrix>&, const vector<FlowParent>&, int);
+template bool findBalancer<Matrix>(int, int, int, OwnedNetwork*, FlowStoreStats*, SearchOptions);
+template bool findBalancer<ExactMatrix>(int, int, int, OwnedNetwork*, FlowStoreStats*, SearchOptions);
+template bool isBalancer(const Matrix&);
+template bool isBalancer(const ExactMatrix&);
+template vector<vector<int>> minBalancerSplitters<Matrix>(int, int, SearchOptions);
+template vector<vector<int>> minBalancerSplitters<ExactMatrix>(int, int, SearchOptions);
+template void expandSearch(SearchState<Matrix>&, int, SearchOptions, vector<size_t>*);
+template void expandSearch(SearchState<ExactMatrix>&, int, SearchOptions, vector<size_t>*);
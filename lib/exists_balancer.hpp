@@ -2,6 +2,127 @@
 
 #pragma once
 
+#include <cstdint>
+#include <functional>
+#include <string>
+
 #include "types.hpp"
+#include "checkpoint.hpp"
+#include "flow_store.hpp"
+#include "search_stats.hpp"
+
+// List every splitter wiring that can be attached to a flow without creating a
+// loop that has no way out
+template <class M>
+Configs validConfigs(const M& flow);
+
+// How far a search has got, after each level
+struct SearchProgress {
+  // Levels done, i.e. splitters placed, out of max_num_splitters
+  int level;
+  int max_num_splitters;
+  // Flows found so far, and the ones first found in the last level done
+  size_t visited;
+  size_t frontier;
+  // How many of frontier have been expanded into the next level; 0 at the
+  // end of a level
+  size_t frontier_done;
+  // Since the search (or this resume of it) started
+  double seconds;
+};
+
+// How existsBalancer searches
+struct SearchOptions {
+  // Threads expanding each level; <= 0 uses every core. The result and the
+  // flows visited don't depend on it.
+  int threads = 1;
+  // Stop as soon as the balancer is found, and drop flows whose input/output
+  // counts can't reach the balancer's with the splitters left. The visited
+  // flows are then only the ones the search needed.
+  bool prune = false;
+  // If > 0, keep the search's flows on disk rather than in memory: the flows
+  // each level makes are written out as sorted runs whenever they take more
+  // than this many bytes, and merged with the flows of earlier levels to drop
+  // the ones already found. Memory use is then about this plus a frontier
+  // batch, and visited_stats only has entries, and flow_bytes on disk.
+  size_t memory_limit = 0;
+  // Where the runs go while searching; the system's temporary directory if
+  // empty
+  string spill_directory;
+  // If set, save the search's state here after every level, and every
+  // checkpoint_seconds (if > 0) within a level, for resumeBalancer to carry on
+  // from. Not supported with memory_limit.
+  string checkpoint_path;
+  double checkpoint_seconds = 0;
+  // Called after every level, and every progress_seconds (if > 0) within a
+  // level. logProgress prints a line each time.
+  function<void(const SearchProgress&)> progress;
+  double progress_seconds = 0;
+  // If given, gets a LevelStats for every level expanded (see
+  // search_stats.hpp)
+  SearchStats* stats = nullptr;
+};
+
+// Print a line about how far a search has got
+void logProgress(const SearchProgress& progress);
+
+// Check whether an input_size -> output_size balancer can be built from at most
+// max_num_splitters splitters. If visited_stats is given, it receives the load
+// and memory use of the set of flows visited by the search.
+// With M = ExactMatrix the search uses exact fractions, so flows that only
+// differ by rounding are deduplicated and the final check is exact.
+template <class M = Matrix>
+bool existsBalancer(int input_size, int output_size, int max_num_splitters, FlowStoreStats* visited_stats = nullptr,
+                    SearchOptions options = SearchOptions());
+
+// Where a visited flow came from: the visited index of the flow it was made
+// from (-1 for {{1}}), and which of that flow's validConfigs made it
+struct FlowParent {
+  int32_t parent;
+  int32_t config;
+};
+
+// existsBalancer that also builds a balancer it finds into balancer, if given,
+// as a network that outputRatios can check: its splitters, then an input node
+// for each input and an output node for each output. Node 0 is a plain belt,
+// the {{1}} the search starts from. Costs a FlowParent (8 bytes) per visited
+// flow. Not supported with memory_limit or checkpoint_path.
+template <class M = Matrix>
+bool findBalancer(int input_size, int output_size, int max_num_splitters, OwnedNetwork* balancer,
+                  FlowStoreStats* visited_stats = nullptr, SearchOptions options = SearchOptions());
+
+// Build the network of visited flow index by replaying the configs that led to
+// it from {{1}}, laid out as for findBalancer
+template <class M>
+OwnedNetwork witnessNetwork(const BasicFlowStore<M>& visited, const vector<FlowParent>& parents, int index);
+
+// Carry on with the search saved in a checkpoint, from the last point it was
+// saved at. The sizes come from the checkpoint; M has to have its value type
+// (ExactMatrix for exact searches, Matrix otherwise), and options.prune has to
+// be what the search was saved with. The search keeps saving to
+// options.checkpoint_path, or to checkpoint_path if that's empty.
+template <class M = Matrix>
+bool resumeBalancer(const string& checkpoint_path, FlowStoreStats* visited_stats = nullptr,
+                    SearchOptions options = SearchOptions());
+
+// Expand every flow of a search state, without pruning, until its flows are
+// all the ones max_num_splitters splitters can make. A new state should start
+// from {{1}}. If level_ends is given, it gets the number of flows visited at
+// the end of each level expanded, so the flows of a level are the ones
+// between its end and the one before.
+template <class M>
+void expandSearch(SearchState<M>& state, int max_num_splitters, SearchOptions options = SearchOptions(),
+                  vector<size_t>* level_ends = nullptr);
+
+// Whether a flow is a balancer: every input goes evenly to every output
+template <class M>
+bool isBalancer(const M& flow);
 
-bool existsBalancer(int input_size, int output_size, int max_num_splitters);
\ No newline at end of file
+// Fewest splitters each balancer of up to max_size inputs and outputs can be
+// built from, as [input_size - 1][output_size - 1], or -1 if it needs more
+// than max_num_splitters. Done in one search from {{1}}: each new flow is
+// checked against the table of balancers not found yet, pruning (if on) only
+// drops flows none of those can be made from, and the search stops once all of
+// them are found. Not for use with memory_limit or checkpoint_path.
+template <class M = Matrix>
+vector<vector<int>> minBalancerSplitters(int max_size, int max_num_splitters, SearchOptions options = SearchOptions());
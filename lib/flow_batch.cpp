@@ -0,0 +1,201 @@
+// Many same-shaped flows processed together
+
+#include <algorithm>
+
+#include "flow_batch.hpp"
+
+// Clones of the double kernel for each instruction set, chosen at load time.
+// Floating point contraction stays off so that every clone rounds exactly like
+// the scalar code.
+#if defined(__x86_64__) && defined(__GNUC__)
+#define BATCH_TARGETS __attribute__((target_clones("avx512f", "avx2", "default")))
+#else
+#define BATCH_TARGETS
+#endif
+#ifdef __clang__
+#pragma clang fp contract(off)
+#endif
+
+template <class T>
+void FlowBatch<T>::store(int lane, const BasicMatrix<T>& flow) {
+  if (flow.rows() != rows_ || flow.cols() != cols_) {
+    throw "Flow shape doesn't match the batch";
+  }
+  for (int i = 0; i < rows_; ++i) {
+    for (int j = 0; j < cols_; ++j) {
+      (*this)(i, j)[lane] = flow[i][j];
+    }
+  }
+}
+
+template <class T>
+BasicMatrix<T> FlowBatch<T>::load(int lane) const {
+  BasicMatrix<T> flow(rows_, cols_);
+  for (int i = 0; i < rows_; ++i) {
+    for (int j = 0; j < cols_; ++j) {
+      flow[i][j] = (*this)(i, j)[lane];
+    }
+  }
+  return flow;
+}
+
+namespace {
+
+const int lane_block = FlowBatch<double>::lane_block;
+
+// Loops over the values of an entry, in blocks of lane_block so every block is
+// one or a few vector instructions. count is a multiple of lane_block.
+template <class T>
+__attribute__((always_inline)) inline void fillLanes(T* __restrict out, T value, int count) {
+  for (int l = 0; l < count; l += lane_block) {
+    for (int v = 0; v < lane_block; ++v) {
+      out[l + v] = value;
+    }
+  }
+}
+
+template <class T>
+__attribute__((always_inline)) inline void copyLanes(T* __restrict out, const T* __restrict in, int count) {
+  for (int l = 0; l < count; l += lane_block) {
+    for (int v = 0; v < lane_block; ++v) {
+      out[l + v] = in[l + v];
+    }
+  }
+}
+
+// out = base + a * b, with base = 0 if it's null
+template <class T>
+__attribute__((always_inline)) inline void multiplyAddLanes(T* __restrict out, const T* __restrict base,
+                                                            const T* __restrict a, const T* __restrict b, int count) {
+  for (int l = 0; l < count; l += lane_block) {
+    for (int v = 0; v < lane_block; ++v) {
+      out[l + v] = (base != nullptr ? base[l + v] : T(0)) + a[l + v] * b[l + v];
+    }
+  }
+}
+
+// The same steps as attachSplitter, but with every value a row of lanes, and
+// writing the kept rows and columns straight into the result instead of
+// appending and erasing. Inlined into each instruction set's clone.
+template <class T>
+__attribute__((always_inline)) inline FlowBatch<T> attachLanes(const FlowBatch<T>& flows, const Wiring& splitter_inputs,
+                                                               const Wiring& splitter_outputs) {
+  const int num_flow_outputs = flows.rows();
+  const int num_flow_inputs = flows.cols();
+  const int num_splitter_inputs = splitter_inputs.size();
+  const int num_splitter_outputs = splitter_outputs.size();
+  const int lanes = flows.lanes();
+  const int stride = flows.stride();
+
+  // The flow input fed by the splitter, if any
+  int wired_output = -1;
+  int unwired_outputs = 0;
+  for (int out : splitter_outputs) {
+    if (out == -1) {
+      ++unwired_outputs;
+    } else if (wired_output != -1) {
+      throw "Only one splitter output can be wired back";
+    } else {
+      wired_output = out;
+    }
+  }
+
+  // Splitter output in terms of the flow inputs, then its own new inputs
+  FlowBatch<T> splitter_flow(1, num_flow_inputs + num_splitter_inputs, lanes);
+  for (int k = 0; k < num_splitter_inputs; ++k) {
+    fillLanes(splitter_flow(0, num_flow_inputs + k), T(1) / T(num_splitter_outputs), stride);
+  }
+  for (int in : splitter_inputs) {
+    if (in == -1) {
+      continue;
+    }
+    for (int j = 0; j < num_flow_inputs; ++j) {
+      T* __restrict split = splitter_flow(0, j);
+      const T* __restrict value = flows(in, j);
+      for (int l = 0; l < stride; l += lane_block) {
+        for (int v = 0; v < lane_block; ++v) {
+          split[l + v] += value[l + v] / T(num_splitter_outputs);
+        }
+      }
+    }
+  }
+
+  // Remove the dependency of the splitter on the input it feeds
+  if (wired_output != -1) {
+    vector<T> self_flow(stride);
+    const T* loop = splitter_flow(0, wired_output);
+    for (int l = 0; l < stride; ++l) {
+      self_flow[l] = T(1) / (T(1) - loop[l]);
+    }
+    for (int j = 0; j < num_flow_inputs + num_splitter_inputs; ++j) {
+      T* __restrict split = splitter_flow(0, j);
+      const T* __restrict factor = self_flow.data();
+      for (int l = 0; l < stride; l += lane_block) {
+        for (int v = 0; v < lane_block; ++v) {
+          split[l + v] *= factor[l + v];
+        }
+      }
+    }
+    fillLanes(splitter_flow(0, wired_output), T(0), stride);
+  }
+
+  // Columns that stay: old inputs not fed by the splitter, then the splitter's new inputs
+  vector<int> kept_cols;
+  for (int j = 0; j < num_flow_inputs; ++j) {
+    if (j != wired_output) {
+      kept_cols.push_back(j);
+    }
+  }
+  for (int k = 0; k < num_splitter_inputs; ++k) {
+    if (splitter_inputs[k] == -1) {
+      kept_cols.push_back(num_flow_inputs + k);
+    }
+  }
+
+  // Rows that stay: old outputs not feeding the splitter, then one row per new output
+  vector<int> kept_rows;
+  for (int i = 0; i < num_flow_outputs; ++i) {
+    if (find(splitter_inputs.begin(), splitter_inputs.end(), i) == splitter_inputs.end()) {
+      kept_rows.push_back(i);
+    }
+  }
+
+  FlowBatch<T> result(kept_rows.size() + unwired_outputs, kept_cols.size(), lanes);
+  for (int r = 0; r < kept_rows.size(); ++r) {
+    int i = kept_rows[r];
+    for (int c = 0; c < kept_cols.size(); ++c) {
+      int j = kept_cols[c];
+      const T* old_value = j < num_flow_inputs ? flows(i, j) : nullptr;
+      if (wired_output == -1) {
+        if (old_value != nullptr) {
+          copyLanes(result(r, c), old_value, stride);
+        }
+        continue;
+      }
+      // Old outputs that depended on the fed input now depend on the splitter's inputs
+      multiplyAddLanes(result(r, c), old_value, flows(i, wired_output), splitter_flow(0, j), stride);
+    }
+  }
+  for (int r = kept_rows.size(); r < result.rows(); ++r) {
+    for (int c = 0; c < kept_cols.size(); ++c) {
+      copyLanes(result(r, c), splitter_flow(0, kept_cols[c]), stride);
+    }
+  }
+  return result;
+}
+
+}  // namespace
+
+BATCH_TARGETS
+FlowBatch<double> attachSplitterBatch(const FlowBatch<double>& flows, const Wiring& splitter_inputs,
+                                      const Wiring& splitter_outputs) {
+  return attachLanes(flows, splitter_inputs, splitter_outputs);
+}
+
+FlowBatch<Rational> attachSplitterBatch(const FlowBatch<Rational>& flows, const Wiring& splitter_inputs,
+                                        const Wiring& splitter_outputs) {
+  return attachLanes(flows, splitter_inputs, splitter_outputs);
+}
+
+template class FlowBatch<double>;
+template class FlowBatch<Rational>;
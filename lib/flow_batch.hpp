@@ -0,0 +1,60 @@
+// Many same-shaped flows processed together
+
+#pragma once
+
+#include "types.hpp"
+
+// A batch of flows with the same number of rows and columns, stored
+// structure-of-arrays: the values of entry (i, j), one per flow, are next to
+// each other. An operation on entry (i, j) then runs across the whole batch in
+// one loop, which the compiler turns into vector instructions. Each entry is
+// padded with zeros to a multiple of lane_block values, so those loops can
+// work in fixed-size blocks without a scalar tail.
+template <class T>
+class FlowBatch {
+ public:
+  static const int lane_block = 8;
+
+  FlowBatch(int rows, int cols, int lanes)
+      : rows_(rows), cols_(cols), lanes_(lanes),
+        stride_((lanes + lane_block - 1) / lane_block * lane_block),
+        values((size_t)rows * cols * stride_) {}
+
+  int rows() const { return rows_; }
+  int cols() const { return cols_; }
+  // Number of flows in the batch
+  int lanes() const { return lanes_; }
+  // Number of values per entry, including the padding
+  int stride() const { return stride_; }
+
+  // Entry (i, j) of every flow in the batch
+  T* operator()(int row, int col) { return values.data() + ((size_t)row * cols_ + col) * stride_; }
+  const T* operator()(int row, int col) const { return values.data() + ((size_t)row * cols_ + col) * stride_; }
+
+  // Copy a flow into or out of a lane
+  void store(int lane, const BasicMatrix<T>& flow);
+  BasicMatrix<T> load(int lane) const;
+
+ private:
+  int rows_;
+  int cols_;
+  int lanes_;
+  int stride_;
+  vector<T> values;
+};
+
+// attachSplitter (see network_tools.hpp) on every flow of a batch. Gives the
+// same values as attachSplitter on each flow. A lane where that would throw,
+// because the wiring makes a loop with no way out, gets non-finite values with
+// doubles and throws with Rationals.
+//
+// This is a standalone evaluator: the balancer search doesn't use it, and it
+// only takes configs with at most one splitter output wired back, which covers
+// every config validConfigs makes. A config with both outputs wired throws.
+//
+// The double version is compiled for AVX-512 and AVX2 as well as plain x86-64,
+// and picks the best one the CPU has when the program starts.
+FlowBatch<double> attachSplitterBatch(const FlowBatch<double>& flows, const Wiring& splitter_inputs,
+                                      const Wiring& splitter_outputs);
+FlowBatch<Rational> attachSplitterBatch(const FlowBatch<Rational>& flows, const Wiring& splitter_inputs,
+                                        const Wiring& splitter_outputs);
@@ -0,0 +1,280 @@
+// Sorted runs of encoded flows on disk, for searches that don't fit in memory
+
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <filesystem>
+#include <unistd.h>
+
+#include "flow_runs.hpp"
+
+namespace {
+
+// Buffer size of each open run file
+const size_t file_buffer_bytes = 1 << 16;
+
+// Most runs RunBuffer::finish leaves to be merged at once, to stay well below
+// the open file limit
+const int max_merge_runs = 64;
+
+void appendValue(string& bytes, double value) {
+  // -0.0 == 0.0, so they have to encode the same
+  if (value == 0) {
+    value = 0;
+  }
+  bytes.append((const char*)&value, sizeof(value));
+}
+
+void appendValue(string& bytes, Rational value) {
+  bytes.append((const char*)&value.num, sizeof(value.num));
+  bytes.append((const char*)&value.den, sizeof(value.den));
+}
+
+// Bytes of an encoded value
+size_t valueBytes(double) {
+  return sizeof(double);
+}
+
+size_t valueBytes(Rational value) {
+  return sizeof(value.num) + sizeof(value.den);
+}
+
+void readValue(const char*& data, double& value) {
+  memcpy(&value, data, sizeof(value));
+  data += sizeof(value);
+}
+
+void readValue(const char*& data, Rational& value) {
+  // Encoded values are already in lowest terms
+  memcpy(&value.num, data, sizeof(value.num));
+  memcpy(&value.den, data + sizeof(value.num), sizeof(value.den));
+  data += sizeof(value.num) + sizeof(value.den);
+}
+
+}  // namespace
+
+template <class M>
+void encodeFlow(const M& flow, string& bytes) {
+  if (flow.rows() > UINT16_MAX || flow.cols() > UINT16_MAX) {
+    throw "Flow too large to encode";
+  }
+  uint16_t shape[2] = {(uint16_t)flow.rows(), (uint16_t)flow.cols()};
+  bytes.append((const char*)shape, sizeof(shape));
+  for (int i = 0; i < flow.rows(); ++i) {
+    for (int j = 0; j < flow.cols(); ++j) {
+      appendValue(bytes, flow[i][j]);
+    }
+  }
+}
+
+template <class M>
+M decodeFlow(string_view bytes) {
+  uint16_t shape[2];
+  if (bytes.size() < sizeof(shape)) {
+    throw "Flow encoding too short";
+  }
+  memcpy(shape, bytes.data(), sizeof(shape));
+
+  M flow(shape[0], shape[1]);
+  const char* data = bytes.data() + sizeof(shape);
+  for (int i = 0; i < flow.rows(); ++i) {
+    for (int j = 0; j < flow.cols(); ++j) {
+      if (data + sizeof(flow[i][j]) > bytes.data() + bytes.size()) {
+        throw "Flow encoding too short";
+      }
+      readValue(data, flow[i][j]);
+    }
+  }
+  return flow;
+}
+
+template <class M>
+size_t encodedFlowLength(string_view bytes) {
+  uint16_t shape[2];
+  if (bytes.size() < sizeof(shape)) {
+    throw "Flow encoding too short";
+  }
+  memcpy(shape, bytes.data(), sizeof(shape));
+  return sizeof(shape) + (size_t)shape[0] * shape[1] * valueBytes(typename M::value_type());
+}
+
+SpillDirectory::SpillDirectory(const string& parent) {
+  static atomic<int> searches{0};
+  filesystem::path base = parent.empty() ? filesystem::temp_directory_path() : filesystem::path(parent);
+  base /= "balancer-search-" + to_string(getpid()) + "-" + to_string(searches++);
+
+  error_code error;
+  filesystem::create_directories(base, error);
+  if (error) {
+    throw "Can't create spill directory";
+  }
+  directory = base.string();
+}
+
+SpillDirectory::~SpillDirectory() {
+  error_code error;
+  filesystem::remove_all(directory, error);
+}
+
+string SpillDirectory::path(const string& name) const {
+  return (filesystem::path(directory) / name).string();
+}
+
+RunWriter::RunWriter(const string& path) : file(fopen(path.c_str(), "wb")) {
+  if (file == nullptr) {
+    throw "Can't open run file for writing";
+  }
+  setvbuf(file, nullptr, _IOFBF, file_buffer_bytes);
+}
+
+RunWriter::~RunWriter() {
+  if (file != nullptr) {
+    fclose(file);
+  }
+}
+
+void RunWriter::write(string_view record) {
+  uint32_t size = record.size();
+  fwrite(&size, sizeof(size), 1, file);
+  fwrite(record.data(), 1, record.size(), file);
+  ++num_records;
+}
+
+void RunWriter::close() {
+  bool failed = ferror(file) != 0;
+  failed = fclose(file) != 0 || failed;
+  file = nullptr;
+  if (failed) {
+    throw "Can't write run file";
+  }
+}
+
+RunReader::RunReader(const string& path) : file(fopen(path.c_str(), "rb")) {
+  if (file == nullptr) {
+    throw "Can't open run file for reading";
+  }
+  setvbuf(file, nullptr, _IOFBF, file_buffer_bytes);
+}
+
+RunReader::~RunReader() {
+  fclose(file);
+}
+
+bool RunReader::next(string& record) {
+  uint32_t size;
+  if (fread(&size, sizeof(size), 1, file) != 1) {
+    if (ferror(file)) {
+      throw "Can't read run file";
+    }
+    return false;
+  }
+  record.resize(size);
+  if (fread(record.data(), 1, size, file) != size) {
+    throw "Run file ends in the middle of a record";
+  }
+  return true;
+}
+
+RunMerger::RunMerger(const vector<string>& paths) : heads(paths.size()) {
+  auto greater = [&](int a, int b) { return heads[a] > heads[b]; };
+  for (int r = 0; r < paths.size(); ++r) {
+    readers.push_back(make_unique<RunReader>(paths[r]));
+    if (readers[r]->next(heads[r])) {
+      heap.push_back(r);
+      push_heap(heap.begin(), heap.end(), greater);
+    }
+  }
+}
+
+bool RunMerger::next(string& record) {
+  auto greater = [&](int a, int b) { return heads[a] > heads[b]; };
+  while (!heap.empty()) {
+    pop_heap(heap.begin(), heap.end(), greater);
+    int r = heap.back();
+    heap.pop_back();
+    record.swap(heads[r]);
+    if (readers[r]->next(heads[r])) {
+      heap.push_back(r);
+      push_heap(heap.begin(), heap.end(), greater);
+    }
+
+    // Runs have no duplicates of their own, but may share records
+    if (started && record == last) {
+      continue;
+    }
+    last = record;
+    started = true;
+    return true;
+  }
+  return false;
+}
+
+RunBuffer::RunBuffer(string path_prefix, size_t memory_limit) : prefix(move(path_prefix)), limit(memory_limit) {}
+
+void RunBuffer::add(string_view record) {
+  size_t used = bytes.size() + record.size() + (records.size() + 1) * sizeof(records[0]);
+  if (used > limit && !records.empty()) {
+    spill();
+  }
+  records.push_back({bytes.size(), (uint32_t)record.size()});
+  bytes.append(record);
+}
+
+string RunBuffer::nextPath() {
+  return prefix + to_string(num_runs++);
+}
+
+void RunBuffer::spill() {
+  auto view = [&](const pair<size_t, uint32_t>& record) {
+    return string_view(bytes.data() + record.first, record.second);
+  };
+  sort(records.begin(), records.end(), [&](const auto& a, const auto& b) { return view(a) < view(b); });
+
+  runs.push_back(nextPath());
+  RunWriter run(runs.back());
+  for (int i = 0; i < records.size(); ++i) {
+    if (i == 0 || view(records[i]) != view(records[i - 1])) {
+      run.write(view(records[i]));
+    }
+  }
+  run.close();
+
+  bytes.clear();
+  records.clear();
+}
+
+vector<string> RunBuffer::finish() {
+  if (!records.empty()) {
+    spill();
+  }
+
+  // Merge groups of runs into longer ones until few enough are left
+  string record;
+  while (runs.size() > max_merge_runs) {
+    vector<string> merged;
+    for (int begin = 0; begin < runs.size(); begin += max_merge_runs) {
+      vector<string> group(runs.begin() + begin, runs.begin() + min((int)runs.size(), begin + max_merge_runs));
+      merged.push_back(nextPath());
+      {
+        RunMerger merger(group);
+        RunWriter run(merged.back());
+        while (merger.next(record)) {
+          run.write(record);
+        }
+        run.close();
+      }
+      for (const string& path : group) {
+        filesystem::remove(path);
+      }
+    }
+    runs = move(merged);
+  }
+  return move(runs);
+}
+
+template void encodeFlow(const Matrix&, string&);
+template void encodeFlow(const ExactMatrix&, string&);
+template size_t encodedFlowLength<Matrix>(string_view);
+template size_t encodedFlowLength<ExactMatrix>(string_view);
+template Matrix decodeFlow(string_view);
+template ExactMatrix decodeFlow(string_view);
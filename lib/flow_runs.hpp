@@ -0,0 +1,123 @@
+// Sorted runs of encoded flows on disk, for searches that don't fit in memory
+
+#pragma once
+
+#include <cstdio>
+#include <memory>
+#include <string>
+#include <string_view>
+
+#include "types.hpp"
+
+// Append a flow's encoding to bytes: rows and columns as uint16s, then each
+// value. Equal flows have equal encodings, so flows can be sorted and
+// deduplicated as byte strings.
+template <class M>
+void encodeFlow(const M& flow, string& bytes);
+
+// Decode a flow from the bytes encodeFlow made
+template <class M>
+M decodeFlow(string_view bytes);
+
+// Length of the encoded flow that bytes starts with
+template <class M>
+size_t encodedFlowLength(string_view bytes);
+
+// A directory of its own for one search's runs, under parent (or the system's
+// temporary directory if that's empty). It's removed with everything in it
+// when this goes away.
+class SpillDirectory {
+ public:
+  explicit SpillDirectory(const string& parent);
+  ~SpillDirectory();
+
+  SpillDirectory(const SpillDirectory&) = delete;
+  SpillDirectory& operator=(const SpillDirectory&) = delete;
+
+  // Path of a file in the directory
+  string path(const string& name) const;
+
+ private:
+  string directory;
+};
+
+// Writes records to a run file, each one as a uint32 length then its bytes
+class RunWriter {
+ public:
+  explicit RunWriter(const string& path);
+  ~RunWriter();
+
+  RunWriter(const RunWriter&) = delete;
+  RunWriter& operator=(const RunWriter&) = delete;
+
+  void write(string_view record);
+
+  // Flush and close the file; throws if anything couldn't be written
+  void close();
+
+  size_t records() const { return num_records; }
+
+ private:
+  FILE* file;
+  size_t num_records = 0;
+};
+
+// Reads the records of a run file in order
+class RunReader {
+ public:
+  explicit RunReader(const string& path);
+  ~RunReader();
+
+  RunReader(const RunReader&) = delete;
+  RunReader& operator=(const RunReader&) = delete;
+
+  // Read the next record; returns false at the end of the file
+  bool next(string& record);
+
+ private:
+  FILE* file;
+};
+
+// Merges sorted runs into one sorted stream without duplicates
+class RunMerger {
+ public:
+  explicit RunMerger(const vector<string>& paths);
+
+  // Read the next record; returns false once every run is used up
+  bool next(string& record);
+
+ private:
+  vector<unique_ptr<RunReader>> readers;
+  // Next record of each reader that still has one
+  vector<string> heads;
+  // Readers that still have records, as a min-heap on their heads
+  vector<int> heap;
+  string last;
+  bool started = false;
+};
+
+// Collects records in memory and writes them out as sorted runs without
+// duplicates whenever they take more than memory_limit bytes
+class RunBuffer {
+ public:
+  // Runs are written to path_prefix followed by a number
+  RunBuffer(string path_prefix, size_t memory_limit);
+
+  void add(string_view record);
+
+  // Write out what's left and return the runs, merged down to few enough of
+  // them to be read all at once
+  vector<string> finish();
+
+ private:
+  void spill();
+  string nextPath();
+
+  string prefix;
+  size_t limit;
+  int num_runs = 0;
+  vector<string> runs;
+  // Records back to back, and where each one starts and how long it is
+  string bytes;
+  vector<pair<size_t, uint32_t>> records;
+};
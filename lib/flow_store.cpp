@@ -0,0 +1,143 @@
+// Hash set of canonical flows for deduplicating the balancer search
+
+#include <algorithm>
+#include <string>
+
+#include "hashing.hpp"
+#include "utils.hpp"
+#include "flow_store.hpp"
+
+template <class M>
+uint64_t flowFingerprint(const M& flow) {
+  uint64_t hash = mix64(((uint64_t)flow.rows() << 32) | flow.cols());
+  for (int i = 0; i < flow.rows(); ++i) {
+    for (int j = 0; j < flow.cols(); ++j) {
+      hash = mix64(hash ^ scalarBits(flow[i][j]));
+    }
+  }
+  return hash;
+}
+
+static const size_t initial_capacity = 64;
+
+template <class M>
+BasicFlowStore<M>::BasicFlowStore() : slots(initial_capacity, {0, -1}) {}
+
+template <class M>
+size_t BasicFlowStore<M>::probe(const M& flow, uint64_t fingerprint) const {
+  size_t mask = slots.size() - 1;
+  for (size_t i = fingerprint & mask;; i = (i + 1) & mask) {
+    const Slot& slot = slots[i];
+    if (slot.index == -1) {
+      return i;
+    }
+    if (slot.fingerprint == fingerprint) {
+      if (equals(slot.index, flow)) {
+        return i;
+      }
+      collisions.fetch_add(1, memory_order_relaxed);
+    }
+  }
+}
+
+template <class M>
+bool BasicFlowStore<M>::equals(int index, const M& flow) const {
+  const Entry& entry = entries[index];
+  if (entry.rows != flow.rows() || entry.cols != flow.cols()) {
+    return false;
+  }
+  const T* stored = values.data() + entry.offset;
+  for (int i = 0; i < entry.rows; ++i, stored += entry.cols) {
+    if (!std::equal(stored, stored + entry.cols, flow[i])) {
+      return false;
+    }
+  }
+  return true;
+}
+
+template <class M>
+M BasicFlowStore<M>::operator[](int index) const {
+  const Entry& entry = entries[index];
+  M flow(entry.rows, entry.cols);
+  const T* stored = values.data() + entry.offset;
+  for (int i = 0; i < entry.rows; ++i, stored += entry.cols) {
+    std::copy(stored, stored + entry.cols, flow[i]);
+  }
+  return flow;
+}
+
+template <class M>
+void BasicFlowStore<M>::grow() {
+  vector<Slot> old_slots(slots.size() * 2, {0, -1});
+  swap(slots, old_slots);
+
+  size_t mask = slots.size() - 1;
+  for (const Slot& slot : old_slots) {
+    if (slot.index == -1) {
+      continue;
+    }
+    size_t i = slot.fingerprint & mask;
+    while (slots[i].index != -1) {
+      i = (i + 1) & mask;
+    }
+    slots[i] = slot;
+  }
+}
+
+template <class M>
+bool BasicFlowStore<M>::insert(const M& flow) {
+  // Keep the load factor at most 1/2 so probe sequences stay short
+  if (2 * (entries.size() + 1) > slots.size()) {
+    grow();
+  }
+
+  uint64_t fingerprint = flowFingerprint(flow);
+  Slot& slot = slots[probe(flow, fingerprint)];
+  if (slot.index != -1) {
+    return false;
+  }
+
+  slot = {fingerprint, (int32_t)entries.size()};
+  entries.push_back({values.size(), flow.rows(), flow.cols()});
+  for (int i = 0; i < flow.rows(); ++i) {
+    values.insert(values.end(), flow[i], flow[i] + flow.cols());
+  }
+  return true;
+}
+
+template <class M>
+int BasicFlowStore<M>::find(const M& flow) const {
+  return slots[probe(flow, flowFingerprint(flow))].index;
+}
+
+template <class M>
+bool BasicFlowStore<M>::contains(const M& flow) const {
+  return find(flow) != -1;
+}
+
+template <class M>
+FlowStoreStats BasicFlowStore<M>::stats() const {
+  FlowStoreStats stats;
+  stats.entries = entries.size();
+  stats.capacity = slots.size();
+  stats.load_factor = (double)entries.size() / slots.size();
+  stats.collisions = collisions;
+  stats.table_bytes = slots.capacity() * sizeof(Slot) + entries.capacity() * sizeof(Entry);
+  stats.flow_bytes = values.capacity() * sizeof(T);
+  return stats;
+}
+
+template uint64_t flowFingerprint(const Matrix&);
+template uint64_t flowFingerprint(const ExactMatrix&);
+template class BasicFlowStore<Matrix>;
+template class BasicFlowStore<ExactMatrix>;
+
+void log(const FlowStoreStats& stats) {
+  log("Flow store: " + std::to_string(stats.entries) + " flows, " +
+      std::to_string(stats.capacity) + " slots (load " +
+      std::to_string(stats.load_factor) + "), " +
+      std::to_string(stats.collisions) + " fingerprint collisions, " +
+      std::to_string(stats.table_bytes + stats.flow_bytes) + " bytes (" +
+      std::to_string(stats.table_bytes) + " table, " +
+      std::to_string(stats.flow_bytes) + " flows)");
+}
@@ -0,0 +1,84 @@
+// Hash set of canonical flows for deduplicating the balancer search
+
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+
+#include "types.hpp"
+
+// 64-bit fingerprint of a flow matrix; equal matrices have equal fingerprints
+template <class M>
+uint64_t flowFingerprint(const M& flow);
+
+// Load and memory figures of a FlowStore
+struct FlowStoreStats {
+  size_t entries;
+  size_t capacity;
+  double load_factor;
+  // Fingerprints that matched but whose flows were different
+  size_t collisions;
+  size_t table_bytes;
+  size_t flow_bytes;
+};
+
+// Open-addressing (linear probing) hash set of flows, keyed by flowFingerprint.
+// Flows are only compared in full when two fingerprints match. Flows are packed
+// back to back in one array and keep their insertion index.
+// Lookups (find, contains, operator[]) may run on several threads at once as
+// long as nothing is being inserted.
+template <class M>
+class BasicFlowStore {
+ public:
+  using T = typename M::value_type;
+
+  BasicFlowStore();
+
+  // Add a flow; returns false if an equal flow is already stored
+  bool insert(const M& flow);
+
+  // Check whether an equal flow is stored
+  bool contains(const M& flow) const;
+
+  // Find the insertion index of a flow, or -1 if it isn't stored
+  int find(const M& flow) const;
+
+  int size() const { return entries.size(); }
+
+  // Copy out the flow with a given insertion index
+  M operator[](int index) const;
+
+  FlowStoreStats stats() const;
+
+ private:
+  struct Slot {
+    uint64_t fingerprint;
+    // Index into entries, or -1 if the slot is empty
+    int32_t index;
+  };
+
+  // Where a flow's values start in values, and its shape
+  struct Entry {
+    size_t offset;
+    int rows;
+    int cols;
+  };
+
+  // Compare a stored flow with another one
+  bool equals(int index, const M& flow) const;
+
+  // Find the slot holding this flow, or the empty slot where it would go
+  size_t probe(const M& flow, uint64_t fingerprint) const;
+  void grow();
+
+  vector<Slot> slots;
+  vector<Entry> entries;
+  vector<T> values;
+  mutable atomic<size_t> collisions{0};
+};
+
+using FlowStore = BasicFlowStore<Matrix>;
+using ExactFlowStore = BasicFlowStore<ExactMatrix>;
+
+// Log a FlowStore's load and memory use to console
+void log(const FlowStoreStats& stats);
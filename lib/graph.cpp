@@ -0,0 +1,116 @@
+// Compact indexed form of a splitter network
+
+#include <algorithm>
+
+#include "graph.hpp"
+
+Graph toGraph(const Network& nodes) {
+  // Node IDs by address, sorted for binary search; one allocation, unlike a
+  // hash map with a node per entry
+  vector<pair<const Node*, int>> ids(nodes.size());
+  for (int i = 0; i < nodes.size(); ++i) {
+    ids[i] = {nodes[i], i};
+  }
+  sort(ids.begin(), ids.end());
+  auto id = [&](const Node* node) {
+    auto it = lower_bound(ids.begin(), ids.end(), make_pair(node, 0));
+    if (it == ids.end() || it->first != node) {
+      throw "Node not found";
+    }
+    return it->second;
+  };
+
+  Graph graph;
+  graph.size = nodes.size();
+  size_t links = 0;
+  for (const Node* node : nodes) {
+    links += node->inputs.size();
+  }
+  graph.input_start.reserve(nodes.size() + 1);
+  graph.output_start.reserve(nodes.size() + 1);
+  graph.inputs.reserve(links);
+  graph.outputs.reserve(links);
+  graph.input_start.push_back(0);
+  graph.output_start.push_back(0);
+  for (const Node* node : nodes) {
+    for (const Node* input : node->inputs) {
+      graph.inputs.push_back(id(input));
+    }
+    for (const Node* output : node->outputs) {
+      graph.outputs.push_back(id(output));
+    }
+    graph.input_start.push_back(graph.inputs.size());
+    graph.output_start.push_back(graph.outputs.size());
+  }
+  return graph;
+}
+
+Components stronglyConnectedComponents(const Graph& graph) {
+  // Tarjan's algorithm with an explicit stack, so long chains don't overflow
+  // the call stack. Components come out sinks first.
+  const int unvisited = -1;
+  vector<int> index(graph.size, unvisited);
+  vector<int> low(graph.size);
+  vector<bool> on_stack(graph.size, false);
+  vector<int> stack;
+  stack.reserve(graph.size);
+  // (node, next output edge to look at)
+  vector<pair<int, int>> calls;
+  calls.reserve(graph.size);
+  // Components are found sinks first, so they are filled in from the back
+  Components components;
+  components.nodes.resize(graph.size);
+  components.start.reserve(graph.size + 1);
+  components.start.push_back(graph.size);
+  int next_index = 0;
+
+  for (int root = 0; root < graph.size; ++root) {
+    if (index[root] != unvisited) {
+      continue;
+    }
+    calls.push_back({root, graph.output_start[root]});
+    index[root] = low[root] = next_index++;
+    stack.push_back(root);
+    on_stack[root] = true;
+
+    while (!calls.empty()) {
+      int node = calls.back().first;
+      int& edge = calls.back().second;
+
+      if (edge < graph.output_start[node + 1]) {
+        int next = graph.outputs[edge++];
+        if (index[next] == unvisited) {
+          index[next] = low[next] = next_index++;
+          stack.push_back(next);
+          on_stack[next] = true;
+          calls.push_back({next, graph.output_start[next]});
+        } else if (on_stack[next]) {
+          low[node] = min(low[node], index[next]);
+        }
+        continue;
+      }
+
+      calls.pop_back();
+      if (!calls.empty()) {
+        int parent = calls.back().first;
+        low[parent] = min(low[parent], low[node]);
+      }
+      if (low[node] == index[node]) {
+        int end = components.start.back();
+        int begin = end;
+        int member;
+        do {
+          member = stack.back();
+          stack.pop_back();
+          on_stack[member] = false;
+          components.nodes[--begin] = member;
+        } while (member != node);
+        sort(components.nodes.begin() + begin, components.nodes.begin() + end);
+        components.start.push_back(begin);
+      }
+    }
+  }
+
+  reverse(components.start.begin(), components.start.end());
+  return components;
+}
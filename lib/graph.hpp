@@ -0,0 +1,37 @@
+// Compact indexed form of a splitter network
+
+#pragma once
+
+#include "types.hpp"
+
+// A network with integer node IDs and its links in compressed sparse row form:
+// the nodes feeding node i are inputs[input_start[i]] .. inputs[input_start[i + 1] - 1],
+// in the same order as Node::inputs, and likewise for outputs.
+struct Graph {
+  int size = 0;
+  vector<int> input_start;
+  vector<int> inputs;
+  vector<int> output_start;
+  vector<int> outputs;
+
+  int inputCount(int node) const { return input_start[node + 1] - input_start[node]; }
+  int outputCount(int node) const { return output_start[node + 1] - output_start[node]; }
+};
+
+// Number the nodes of a network by their position in it
+Graph toGraph(const Network& nodes);
+
+// Strongly connected components of a graph, in the same packed form: component
+// c is nodes[start[c]] .. nodes[start[c + 1] - 1], in increasing order.
+struct Components {
+  vector<int> start;
+  vector<int> nodes;
+
+  int count() const { return start.size() - 1; }
+  int size(int component) const { return start[component + 1] - start[component]; }
+  const int* begin(int component) const { return nodes.data() + start[component]; }
+};
+
+// Strongly connected components of a graph, in topological order: no node
+// feeds a component that comes before its own
+Components stronglyConnectedComponents(const Graph& graph);
@@ -0,0 +1,31 @@
+// Hashing helpers for flow values
+
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+
+#include "rational.hpp"
+
+// Mixing step of splitmix64
+inline uint64_t mix64(uint64_t x) {
+  x += 0x9e3779b97f4a7c15ull;
+  x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ull;
+  x = (x ^ (x >> 27)) * 0x94d049bb133111ebull;
+  return x ^ (x >> 31);
+}
+
+// Bits of a flow value to feed into a hash; equal values give equal bits
+inline uint64_t scalarBits(double value) {
+  // -0.0 == 0.0, so they have to hash the same
+  if (value == 0) {
+    return 0;
+  }
+  uint64_t bits;
+  memcpy(&bits, &value, sizeof(bits));
+  return bits;
+}
+
+inline uint64_t scalarBits(Rational value) {
+  return mix64(value.num) ^ value.den;
+}
@@ -0,0 +1,37 @@
+// In-place kernels on rows of flow values
+
+#pragma once
+
+// These work on a pointer to the first value and a length, like the rows of a
+// BasicMatrix, so they never allocate or copy. y and x must not overlap.
+
+// y += x
+template <class T>
+inline void addInPlace(T* y, const T* x, int n) {
+  for (int k = 0; k < n; ++k) {
+    y[k] += x[k];
+  }
+}
+
+// y += a * x
+template <class T>
+inline void axpy(T* y, const T* x, T a, int n) {
+  for (int k = 0; k < n; ++k) {
+    y[k] += x[k] * a;
+  }
+}
+
+// y *= a
+template <class T>
+inline void scaleInPlace(T* y, T a, int n) {
+  for (int k = 0; k < n; ++k) {
+    y[k] *= a;
+  }
+}
+
+// y *= a, then clear y[zero]; eliminating a node's dependency on itself
+template <class T>
+inline void scaleAndZero(T* y, T a, int n, int zero) {
+  scaleInPlace(y, a, n);
+  y[zero] = T(0);
+}
@@ -0,0 +1,275 @@
+// Dense row-major matrix with small-size inline storage
+
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <initializer_list>
+#include <memory>
+#include <vector>
+
+// Rows are stored back to back, each taking stride() entries, of which the
+// first cols() are used. Matrices of up to InlineCapacity entries live inside
+// the object itself, so the small flows of the balancer search never touch the
+// allocator. Rows and columns can be added and erased in place.
+//
+// operator[] returns a pointer to the start of a row, so flow[i][j] works the
+// same way as it did with vector<vector<double>>.
+//
+// With FixedStride > 0 the stride is a compile-time constant, so indexing
+// needs no load and rows never move when columns are added; a matrix can then
+// have at most FixedStride columns.
+template <class T, int InlineCapacity = 64, int FixedStride = 0>
+class BasicMatrix {
+  static_assert(InlineCapacity > 0, "BasicMatrix needs some inline storage");
+  static_assert(FixedStride <= InlineCapacity, "BasicMatrix needs room for a row inline");
+
+ public:
+  using value_type = T;
+
+  BasicMatrix() {}
+
+  // A rows x cols matrix filled with value
+  BasicMatrix(int rows, int cols, T value = T()) {
+    reserve(rows, cols);
+    rows_ = rows;
+    cols_ = cols;
+    std::fill(data_, data_ + (size_t)rows * stride_, value);
+  }
+
+  // Build from nested lists, e.g. {{1, 0}, {0, 1}}
+  BasicMatrix(std::initializer_list<std::initializer_list<T>> values) {
+    int rows = values.size();
+    int cols = rows > 0 ? values.begin()->size() : 0;
+    reserve(rows, cols);
+    for (auto& row : values) {
+      if ((int)row.size() != cols) {
+        throw "Row sizes mismatch";
+      }
+      std::copy(row.begin(), row.end(), data_ + (size_t)rows_ * stride_);
+      ++rows_;
+    }
+    cols_ = cols;
+  }
+
+  BasicMatrix(const BasicMatrix& other) { *this = other; }
+
+  BasicMatrix(BasicMatrix&& other) noexcept { *this = std::move(other); }
+
+  BasicMatrix& operator=(const BasicMatrix& other) {
+    if (this != &other) {
+      rows_ = 0;
+      cols_ = 0;
+      reserve(other.rows_, other.cols_);
+      rows_ = other.rows_;
+      cols_ = other.cols_;
+      for (int i = 0; i < rows_; ++i) {
+        std::copy(other[i], other[i] + cols_, (*this)[i]);
+      }
+    }
+    return *this;
+  }
+
+  BasicMatrix& operator=(BasicMatrix&& other) noexcept {
+    if (this == &other) {
+      return *this;
+    }
+    if (other.heap_data_) {
+      heap_data_ = std::move(other.heap_data_);
+      data_ = heap_data_.get();
+      capacity_ = other.capacity_;
+      stride_ = other.stride_;
+    } else {
+      heap_data_.reset();
+      data_ = inline_data_;
+      capacity_ = InlineCapacity;
+      stride_ = other.stride_;
+      std::copy(other.data_, other.data_ + (size_t)other.rows_ * other.stride_, data_);
+    }
+    rows_ = other.rows_;
+    cols_ = other.cols_;
+
+    other.data_ = other.inline_data_;
+    other.capacity_ = InlineCapacity;
+    other.rows_ = 0;
+    other.cols_ = 0;
+    other.stride_ = FixedStride;
+    return *this;
+  }
+
+  int rows() const { return rows_; }
+  int cols() const { return cols_; }
+  // Distance between the starts of two rows
+  int stride() const { return FixedStride > 0 ? FixedStride : stride_; }
+  // Number of rows, like the old vector<Row>
+  int size() const { return rows_; }
+  bool empty() const { return rows_ == 0; }
+
+  T* operator[](int row) { return data_ + (size_t)row * stride(); }
+  const T* operator[](int row) const { return data_ + (size_t)row * stride(); }
+
+  // Copy a row out
+  std::vector<T> row(int row) const {
+    return std::vector<T>((*this)[row], (*this)[row] + cols_);
+  }
+
+  // Make room for rows x cols entries without changing the contents
+  void reserve(int rows, int cols) {
+    if (FixedStride > 0 && cols > FixedStride) {
+      throw "Too many columns for a fixed-stride matrix";
+    }
+    relayout(rows, std::max(stride_, cols));
+  }
+
+  // Change the shape, keeping the overlapping entries; new entries are zero
+  void resize(int rows, int cols) {
+    reserve(rows, cols);
+    for (int i = 0; i < std::min(rows, rows_) && cols > cols_; ++i) {
+      std::fill((*this)[i] + cols_, (*this)[i] + cols, T());
+    }
+    for (int i = rows_; i < rows; ++i) {
+      std::fill((*this)[i], (*this)[i] + cols, T());
+    }
+    rows_ = rows;
+    cols_ = cols;
+  }
+
+  // Add a row at the bottom
+  void appendRow(const T* values) {
+    reserve(rows_ + 1, cols_);
+    std::copy(values, values + cols_, (*this)[rows_]);
+    ++rows_;
+  }
+
+  // Add zero columns on the right
+  void appendColumns(int count) { resize(rows_, cols_ + count); }
+
+  void eraseRow(int row) {
+    std::copy((*this)[row + 1], (*this)[rows_], (*this)[row]);
+    --rows_;
+  }
+
+  void eraseColumn(int column) {
+    for (int i = 0; i < rows_; ++i) {
+      std::copy((*this)[i] + column + 1, (*this)[i] + cols_, (*this)[i] + column);
+    }
+    --cols_;
+  }
+
+  void swapRows(int a, int b) {
+    std::swap_ranges((*this)[a], (*this)[a] + cols_, (*this)[b]);
+  }
+
+  // Swap rows and columns without a second buffer, by following the cycles of
+  // the permutation through the packed values. Each cycle is moved once, from
+  // its smallest index; finding those takes O(size * cycle length) steps at
+  // worst, which is nothing for the small flows of the search.
+  void transposeInPlace() {
+    // A fixed stride has to fit the new rows, and there has to be room for them
+    if (FixedStride > 0) {
+      reserve(cols_, rows_);
+    }
+
+    // Pack the rows together first; destinations are never past their sources
+    for (int i = 1; i < rows_; ++i) {
+      std::copy((*this)[i], (*this)[i] + cols_, data_ + (size_t)i * cols_);
+    }
+
+    size_t size = (size_t)rows_ * cols_;
+    auto target = [&](size_t p) { return (p % cols_) * rows_ + p / cols_; };
+    for (size_t start = 1; start + 1 < size; ++start) {
+      size_t p = target(start);
+      while (p > start) {
+        p = target(p);
+      }
+      if (p < start) {
+        continue;
+      }
+      T carried = data_[start];
+      for (p = target(start); p != start; p = target(p)) {
+        std::swap(carried, data_[p]);
+      }
+      data_[start] = carried;
+    }
+
+    std::swap(rows_, cols_);
+    if (FixedStride > 0) {
+      // Spread the rows back out, starting from the last one
+      for (int i = rows_ - 1; i > 0; --i) {
+        std::copy_backward(data_ + (size_t)i * cols_, data_ + (size_t)(i + 1) * cols_,
+                           data_ + (size_t)i * FixedStride + cols_);
+      }
+    } else {
+      stride_ = cols_;
+    }
+  }
+
+  // Bytes allocated outside the object
+  size_t heapBytes() const { return heap_data_ ? capacity_ * sizeof(T) : 0; }
+
+  friend bool operator==(const BasicMatrix& a, const BasicMatrix& b) {
+    if (a.rows_ != b.rows_ || a.cols_ != b.cols_) {
+      return false;
+    }
+    for (int i = 0; i < a.rows_; ++i) {
+      if (!std::equal(a[i], a[i] + a.cols_, b[i])) {
+        return false;
+      }
+    }
+    return true;
+  }
+
+  friend bool operator!=(const BasicMatrix& a, const BasicMatrix& b) { return !(a == b); }
+
+  // Lexicographic by rows, the same order as vector<vector<T>>
+  friend bool operator<(const BasicMatrix& a, const BasicMatrix& b) {
+    int rows = std::min(a.rows_, b.rows_);
+    for (int i = 0; i < rows; ++i) {
+      if (std::lexicographical_compare(a[i], a[i] + a.cols_, b[i], b[i] + b.cols_)) {
+        return true;
+      }
+      if (std::lexicographical_compare(b[i], b[i] + b.cols_, a[i], a[i] + a.cols_)) {
+        return false;
+      }
+    }
+    return a.rows_ < b.rows_;
+  }
+
+ private:
+  // Ensure room for rows rows of the given stride, moving the rows if the stride grows.
+  // The existing rows all move, so there must be room for them too.
+  void relayout(int rows, int stride) {
+    size_t needed = (size_t)std::max(rows, rows_) * stride;
+    if (stride == stride_ && needed <= capacity_) {
+      return;
+    }
+
+    if (needed <= capacity_) {
+      // Spread the rows out in place, starting from the last one
+      for (int i = rows_ - 1; i > 0; --i) {
+        std::copy_backward((*this)[i], (*this)[i] + cols_, data_ + (size_t)i * stride + cols_);
+      }
+      stride_ = stride;
+      return;
+    }
+
+    size_t capacity = std::max(needed, 2 * capacity_);
+    std::unique_ptr<T[]> heap_data(new T[capacity]);
+    for (int i = 0; i < rows_; ++i) {
+      std::copy((*this)[i], (*this)[i] + cols_, heap_data.get() + (size_t)i * stride);
+    }
+    heap_data_ = std::move(heap_data);
+    data_ = heap_data_.get();
+    capacity_ = capacity;
+    stride_ = stride;
+  }
+
+  T inline_data_[InlineCapacity];
+  std::unique_ptr<T[]> heap_data_;
+  T* data_ = inline_data_;
+  size_t capacity_ = InlineCapacity;
+  int rows_ = 0;
+  int cols_ = 0;
+  // Always FixedStride if that is set
+  int stride_ = FixedStride;
+};
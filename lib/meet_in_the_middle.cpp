@@ -0,0 +1,287 @@
+// Balancer search by composing the flows of two smaller searches
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <mutex>
+#include <type_traits>
+#include <unordered_map>
+
+#include "checkpoint.hpp"
+#include "meet_in_the_middle.hpp"
+#include "thread_pool.hpp"
+
+namespace {
+
+// How far apart double sums of products can be and still count as equal
+const double tolerance = 1e-9;
+
+template <class T>
+bool atMost(T a, T b) {
+  if constexpr (is_same<T, double>::value) {
+    return a <= b + tolerance;
+  } else {
+    return !(b < a);
+  }
+}
+
+template <class T>
+bool nearlyEqual(T a, T b) {
+  if constexpr (is_same<T, double>::value) {
+    return fabs(a - b) <= tolerance;
+  } else {
+    return a == b;
+  }
+}
+
+uint64_t shapeKey(int rows, int cols) {
+  return (uint64_t)(uint32_t)rows << 32 | (uint32_t)cols;
+}
+
+// A flow of the half search, with what the pair bounds need: its largest
+// entry, and the smallest of the largest entries of its rows (for a first
+// half) or of its columns (for a second half)
+template <class M>
+struct Half {
+  using T = typename M::value_type;
+
+  M flow;
+  int splitters;
+  T largest;
+  T smallest_line_max;
+
+  Half(M half_flow, int half_splitters, bool by_rows) : flow(move(half_flow)), splitters(half_splitters) {
+    int lines = by_rows ? flow.rows() : flow.cols();
+    int length = by_rows ? flow.cols() : flow.rows();
+    for (int a = 0; a < lines; ++a) {
+      T line_max = T();
+      for (int b = 0; b < length; ++b) {
+        T value = by_rows ? flow[a][b] : flow[b][a];
+        line_max = max(line_max, value);
+      }
+      largest = a == 0 ? line_max : max(largest, line_max);
+      smallest_line_max = a == 0 ? line_max : min(smallest_line_max, line_max);
+    }
+  }
+};
+
+// Finds a wiring of first's outputs to second's inputs that makes a balancer,
+// one output of first at a time, keeping every entry of the partial product
+// at most share
+template <class M>
+class WiringSearch {
+  using T = typename M::value_type;
+
+ public:
+  WiringSearch(const M& first_flow, const M& second_flow)
+      : first(first_flow), second(second_flow), middle(first.rows()), inputs(first.cols()), outputs(second.rows()),
+        share(T(1) / T(outputs)), sums((middle + 1) * inputs * outputs, T()), wiring(middle) {
+    // Outputs of first with the biggest entries first, as they rule out the
+    // most; and each input of second as its first twin, so twins are tried once
+    for (int j = 0; j < middle; ++j) {
+      order.push_back(j);
+    }
+    auto row_max = [&](int j) { return *max_element(first[j], first[j] + inputs); };
+    stable_sort(order.begin(), order.end(), [&](int a, int b) { return row_max(b) < row_max(a); });
+    for (int t = 0; t < middle; ++t) {
+      twin.push_back(t);
+      for (int u = 0; u < t; ++u) {
+        bool same = true;
+        for (int i = 0; i < outputs && same; ++i) {
+          same = second[i][t] == second[i][u];
+        }
+        if (same) {
+          twin[t] = twin[u];
+          break;
+        }
+      }
+    }
+  }
+
+  bool find(vector<int>& found) {
+    if (!place(0, 0)) {
+      return false;
+    }
+    found = wiring;
+    return true;
+  }
+
+ private:
+  bool place(int step, uint64_t used) {
+    const T* sum = &sums[step * inputs * outputs];
+    if (step == middle) {
+      for (int k = 0; k < inputs * outputs; ++k) {
+        if (!nearlyEqual(sum[k], share)) {
+          return false;
+        }
+      }
+      return true;
+    }
+
+    int j = order[step];
+    T* next = &sums[(step + 1) * inputs * outputs];
+    uint64_t tried = 0;
+    for (int t = 0; t < middle; ++t) {
+      if ((used >> t & 1) || (tried >> twin[t] & 1)) {
+        continue;
+      }
+      tried |= uint64_t(1) << twin[t];
+
+      bool fits = true;
+      for (int i = 0; i < outputs && fits; ++i) {
+        T weight = second[i][t];
+        for (int c = 0; c < inputs; ++c) {
+          T value = sum[i * inputs + c] + weight * first[j][c];
+          next[i * inputs + c] = value;
+          if (!atMost(value, share)) {
+            fits = false;
+            break;
+          }
+        }
+      }
+      if (fits) {
+        wiring[j] = t;
+        if (place(step + 1, used | uint64_t(1) << t)) {
+          return true;
+        }
+      }
+    }
+    return false;
+  }
+
+  const M& first;
+  const M& second;
+  int middle;
+  int inputs;
+  int outputs;
+  T share;
+  // The partial product after each step, outputs x inputs each
+  vector<T> sums;
+  vector<int> order;
+  vector<int> twin;
+  vector<int> wiring;
+};
+
+// Plain belts: the identity flow of size x size
+template <class M>
+M belts(int size) {
+  using T = typename M::value_type;
+  M flow(size, size, T());
+  for (int i = 0; i < size; ++i) {
+    flow[i][i] = T(1);
+  }
+  return flow;
+}
+
+}  // namespace
+
+template <class M>
+bool existsComposedBalancer(int input_size, int output_size, int max_num_splitters, BasicComposition<M>* found,
+                            SearchOptions options) {
+  using T = typename M::value_type;
+  if (options.memory_limit > 0 || !options.checkpoint_path.empty()) {
+    throw "existsComposedBalancer doesn't support memory_limit or checkpoints";
+  }
+  int half_splitters = (max_num_splitters + 1) / 2;
+
+  // Every flow of up to half the splitters, and where each level's new ones end
+  SearchState<M> state;
+  state.input_size = input_size;
+  state.output_size = output_size;
+  state.visited.insert({{1}});
+  state.frontier.push_back(0);
+  vector<size_t> level_ends = {1};
+  expandSearch(state, half_splitters, options, &level_ends);
+  level_ends.resize(half_splitters + 1, level_ends.back());
+
+  // First halves by how many splitters they take, and second halves indexed
+  // by shape, each bucket by largest entry
+  vector<Half<M>> firsts;
+  unordered_map<uint64_t, vector<Half<M>>> seconds;
+  int level = 0;
+  for (int index = 0; index < state.visited.size(); ++index) {
+    while (index >= level_ends[level]) {
+      ++level;
+    }
+    M flow = state.visited[index];
+    if (flow.cols() == input_size && flow.rows() == output_size && isBalancer(flow)) {
+      if (found != nullptr) {
+        *found = {flow, belts<M>(output_size), vector<int>(), level, 0};
+        for (int j = 0; j < output_size; ++j) {
+          found->wiring.push_back(j);
+        }
+      }
+      return true;
+    }
+    if (flow.cols() == input_size) {
+      firsts.emplace_back(flow, level, true);
+    }
+    if (flow.rows() == output_size) {
+      seconds[shapeKey(flow.rows(), flow.cols())].emplace_back(flow, level, false);
+    }
+  }
+  for (auto& bucket : seconds) {
+    sort(bucket.second.begin(), bucket.second.end(),
+         [](const Half<M>& a, const Half<M>& b) { return a.largest < b.largest; });
+  }
+
+  // The first half with a match that comes first in visited order wins, and
+  // its first match in bucket order, as with one thread: a worker only looks
+  // at first halves before the best one found so far
+  T share = T(1) / T(output_size);
+  ThreadPool pool(options.threads);
+  atomic<int> best_first(firsts.size());
+  mutex found_lock;
+  pool.parallelFor(firsts.size(), [&](int, int a) {
+    const Half<M>& first = firsts[a];
+    auto bucket = seconds.find(shapeKey(output_size, first.flow.rows()));
+    if (a >= best_first || bucket == seconds.end() || first.flow.rows() > 64) {
+      return;
+    }
+    // Some output of first gets first.smallest_line_max from an input, and
+    // feeds the column of second with its largest entry or a bigger one
+    const vector<Half<M>>& candidates = bucket->second;
+    auto end = partition_point(candidates.begin(), candidates.end(), [&](const Half<M>& second) {
+      return atMost(second.largest * first.smallest_line_max, share);
+    });
+    for (auto second = candidates.begin(); second != end && a < best_first; ++second) {
+      if (first.splitters + second->splitters > max_num_splitters ||
+          !atMost(first.largest * second->smallest_line_max, share)) {
+        continue;
+      }
+      vector<int> wiring;
+      if (WiringSearch<M>(first.flow, second->flow).find(wiring)) {
+        lock_guard<mutex> guard(found_lock);
+        if (a < best_first) {
+          if (found != nullptr) {
+            *found = {first.flow, second->flow, wiring, first.splitters, second->splitters};
+          }
+          best_first = a;
+        }
+        break;
+      }
+    }
+  });
+  return best_first < firsts.size();
+}
+
+template <class M>
+M composedFlow(const BasicComposition<M>& composition) {
+  using T = typename M::value_type;
+  const M& first = composition.first;
+  const M& second = composition.second;
+  M flow(second.rows(), first.cols(), T());
+  for (int j = 0; j < first.rows(); ++j) {
+    for (int i = 0; i < second.rows(); ++i) {
+      for (int c = 0; c < first.cols(); ++c) {
+        flow[i][c] += second[i][composition.wiring[j]] * first[j][c];
+      }
+    }
+  }
+  return flow;
+}
+
+template bool existsComposedBalancer<Matrix>(int, int, int, Composition*, SearchOptions);
+template bool existsComposedBalancer<ExactMatrix>(int, int, int, ExactComposition*, SearchOptions);
+template Matrix composedFlow(const Composition&);
+template ExactMatrix composedFlow(const ExactComposition&);
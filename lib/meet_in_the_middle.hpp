@@ -0,0 +1,51 @@
+// Balancer search by composing the flows of two smaller searches
+
+#pragma once
+
+#include "types.hpp"
+#include "exists_balancer.hpp"
+
+// A balancer made of two networks in series: every output of the first goes
+// to an input of the second, output j to input wiring[j]. first is
+// input_size -> middle and second is middle -> output_size, as flows
+// (rows are outputs), so the balancer's flow is second * P * first, with P
+// the wiring's permutation matrix.
+template <class M>
+struct BasicComposition {
+  M first;
+  M second;
+  vector<int> wiring;
+  int first_splitters;
+  int second_splitters;
+};
+
+using Composition = BasicComposition<Matrix>;
+using ExactComposition = BasicComposition<ExactMatrix>;
+
+// Look for an input_size -> output_size balancer of at most max_num_splitters
+// splitters made of two halves of at most (max_num_splitters + 1) / 2
+// splitters each. One unpruned search finds every flow of that many
+// splitters; then for each flow with input_size inputs, the flows it can feed
+// are looked up in a hash index by their shape (its outputs, output_size
+// outputs), and narrowed down by their largest entry: each term of the
+// product is non-negative, so a pair whose largest entries multiply to more
+// than 1 / output_size can't be part of a balancer. The wiring is found by
+// backtracking over which input each output goes to, with the same bound on
+// every partial product. The halves' flows conserve what goes in, so once
+// every entry is at most 1 / output_size they are all exactly that. Balancers
+// the search finds whole (with up to half the splitters) count too.
+//
+// This finds a balancer in far fewer flows than existsBalancer needs for the
+// same budget, but not every balancer: only ones that split into two halves
+// of at most half the splitters each, with no links going back from the
+// second half to the first. So true means there is one, and false only that
+// this didn't find one. If found is given and there is one, it gets the
+// halves; which halves doesn't depend on options.threads. Not for use with
+// memory_limit or checkpoint_path.
+template <class M = Matrix>
+bool existsComposedBalancer(int input_size, int output_size, int max_num_splitters,
+                            BasicComposition<M>* found = nullptr, SearchOptions options = SearchOptions());
+
+// The flow of a composition, second * P * first
+template <class M>
+M composedFlow(const BasicComposition<M>& composition);
@@ -1,15 +1,15 @@
 // Tools for the Network/Matrix domain
 
+#include <algorithm>
+
 #include "types.hpp"
+#include "kernels.hpp"
 #include "utils.hpp"
+#include "canonical_form.hpp"
 #include "network_tools.hpp"
 
 Row zeroRow(int size) {
-  Row zero_row;
-  for (int i = 0; i < size; ++i) {
-    zero_row.push_back(0);
-  }
-  return zero_row;
+  return Row(size);
 }
 
 Row oneRow(int size, int one_position) {
@@ -19,60 +19,48 @@ Row oneRow(int size, int one_position) {
   return one_row;
 }
 
-Row rowAdd(Row A, Row B) {
+template <class T>
+vector<T> rowAdd(const vector<T>& A, const vector<T>& B) {
   if (A.size() != B.size()) {
     throw "Row sizes mismatch";
   }
 
-  Row C = zeroRow(A.size());
-  for (int i = 0; i < A.size(); i++) {
-    C[i] = A[i] + B[i];
-  }
+  vector<T> C = A;
+  addInPlace(C.data(), B.data(), C.size());
   return C;
 }
 
-Row rowMultiply(Row row, double multiplier) {
-  for (int i = 0; i < row.size(); ++i) {
-    row[i] *= multiplier;
-  }
+template <class T>
+vector<T> rowMultiply(vector<T> row, T multiplier) {
+  scaleInPlace(row.data(), multiplier, row.size());
   return row;
 }
 
-Matrix identityMatrix(int size) {
-  Matrix identity_matrix;
+template <class M>
+M identityMatrix(int size) {
+  M identity_matrix(size, size);
   for (int i = 0; i < size; ++i) {
-    identity_matrix.push_back(oneRow(size, i));
+    identity_matrix[i][i] = 1;
   }
   return identity_matrix;
 }
 
-Row getColumn(Matrix matrix, int column_position) {
-  vectorGuard(matrix[0], column_position);
-  Row column;
-  int m = matrix.size();
-  for (int j = 0; j < m; j++) {
-    column.push_back(matrix[j][column_position]);
+template <class M>
+vector<typename M::value_type> getColumn(const M& matrix, int column_position) {
+  if (column_position < 0 || column_position >= matrix.cols()) {
+    throw "Index out of bounds";
+  }
+  vector<typename M::value_type> column(matrix.rows());
+  for (int j = 0; j < matrix.rows(); j++) {
+    column[j] = matrix[j][column_position];
   }
   return column;
 }
 
-Matrix transpose(Matrix matrix) {
-    Matrix transpose_matrix;
-    
-    int m = matrix.size();
-
-    if (m == 0) {
-        return matrix;
-    }
-    
-    int n = matrix[0].size();
-    
-    for (int i = 0; i < n; ++i) {
-        Row column = getColumn(matrix, i);
-        transpose_matrix.push_back(column);
-    }
-    
-    return transpose_matrix;
+template <class M>
+M transpose(M matrix) {
+  matrix.transposeInPlace();
+  return matrix;
 }
 
 Network emptyNetwork(int size) {
@@ -93,7 +81,21 @@ void link(Network& nodes, int source, int target) {
   target_node->inputs.push_back(source_node);
 }
 
-int nodeNum(Network nodes, Node* node) {
+void unlink(Network& nodes, int source, int target) {
+  vectorGuard(nodes, source);
+  vectorGuard(nodes, target);
+  Node* target_node = nodes[target];
+  Node* source_node = nodes[source];
+  auto output = find(source_node->outputs.begin(), source_node->outputs.end(), target_node);
+  auto input = find(target_node->inputs.begin(), target_node->inputs.end(), source_node);
+  if (output == source_node->outputs.end() || input == target_node->inputs.end()) {
+    throw "Link not found";
+  }
+  source_node->outputs.erase(output);
+  target_node->inputs.erase(input);
+}
+
+int nodeNum(const Network& nodes, Node* node) {
   for (int node_num = 0; node_num < nodes.size(); ++node_num) {
     if (node == nodes[node_num]) {
       return node_num;
@@ -102,79 +104,62 @@ int nodeNum(Network nodes, Node* node) {
   throw "Node not found";
 }
 
-using Wiring = vector<int>;
-using Config = vector<Wiring>;
-using Configs = vector<Config>;
+template <class M>
+M attachSplitter(M flow, const Wiring& splitter_inputs, const Wiring& splitter_outputs) {
+    using T = typename M::value_type;
 
-Matrix addSplitterToFlow(Matrix flow, const Wiring splitter_inputs, const Wiring splitter_outputs) {
-    const int num_flow_outputs = flow.size(); // Previously N
-    const int num_flow_inputs = flow[0].size(); // Previously M
+    const int num_flow_outputs = flow.rows(); // Previously N
+    const int num_flow_inputs = flow.cols(); // Previously M
     
     const int num_splitter_outputs = splitter_outputs.size(); // Previously m
     const int num_splitter_inputs = splitter_inputs.size(); // Previously n
 
-    Row splitter_flow = zeroRow(num_flow_inputs);
-    for (int i = 0; i < num_splitter_inputs; ++i) {
-        splitter_flow.push_back(1.0 / num_splitter_outputs);
-    }
+    // Scratch rows, reused between calls so they only allocate while warming up
+    static thread_local vector<T> splitter_flow;
+    static thread_local vector<T> self_flows;
+    splitter_flow.assign(num_flow_inputs + num_splitter_inputs, T(1) / T(num_splitter_outputs));
+    fill(splitter_flow.begin(), splitter_flow.begin() + num_flow_inputs, T(0));
     
     // Find this splitter's output in terms of its input flows
     for (int i = 0; i < num_splitter_inputs; ++i) {
         if (splitter_inputs[i] != -1) {
-            for (int j = 0; j < num_flow_inputs; ++j) {
-                splitter_flow[j] += flow[splitter_inputs[i]][j] / num_splitter_outputs;
-            }
+            axpy(splitter_flow.data(), flow[splitter_inputs[i]], T(1) / T(num_splitter_outputs), num_flow_inputs);
         }
     }
     
-    // Remove circular dependencies of the new outputs on any inputs that they lead to
-    Row new_splitter_flow = splitter_flow;
+    // Remove circular dependencies of the new outputs on any inputs that they lead to.
+    // Each factor comes from the splitter flow before any of them is applied.
+    self_flows.clear();
     for (int i = 0; i < num_splitter_outputs; ++i) {
         if (splitter_outputs[i] != -1) {
-            for (int j = 0; j < num_flow_inputs + num_splitter_inputs; ++j) {
-                new_splitter_flow[j] *= 1 / (1 - splitter_flow[splitter_outputs[i]]);
-                
-                if (splitter_flow[splitter_outputs[i]] == 1) {
-                    splitter_flow = {};
-                }
+            if (splitter_flow[splitter_outputs[i]] == T(1)) {
+                throw "Splitter output only loops back into itself";
             }
-            
-            new_splitter_flow[splitter_outputs[i]] = 0;
+            self_flows.push_back(T(1) / (T(1) - splitter_flow[splitter_outputs[i]]));
+        }
+    }
+    for (int i = 0, wired = 0; i < num_splitter_outputs; ++i) {
+        if (splitter_outputs[i] != -1) {
+            scaleAndZero(splitter_flow.data(), self_flows[wired++], (int)splitter_flow.size(), splitter_outputs[i]);
         }
     }
-    splitter_flow = new_splitter_flow;
     
     // Remove other dependencies on the input (if any) that was just removed
     // Might be wonky when there are two self-loops added at once
+    flow.appendColumns(num_splitter_inputs);
     for (int i = 0; i < num_flow_outputs; ++i) {
-        bool added_inputs = false;
-        
         for (int j = 0; j < num_splitter_outputs; ++j) {
             if (splitter_outputs[j] != -1) {
-                for (int k = 0; k < num_flow_inputs; ++k) {
-                    flow[i][k] += flow[i][splitter_outputs[j]] * splitter_flow[k];
-                }
-                // Add dependencies on inputs
-                for (int k = 0; k < num_splitter_inputs; ++k) {
-                    flow[i].push_back(flow[i][splitter_outputs[j]] * splitter_flow[num_flow_inputs + k]);
-                    
-                    added_inputs = true;
-                }
-                
+                // Dependencies on old inputs, then on the splitter's inputs
+                axpy(flow[i], splitter_flow.data(), flow[i][splitter_outputs[j]], num_flow_inputs + num_splitter_inputs);
                 flow[i][splitter_outputs[j]] = 0;
             }
         }
-        
-        if (!added_inputs) {
-            for (int j = 0; j < num_splitter_inputs; ++j) {
-                flow[i].push_back(0);
-            }
-        }
     }
     
     // Add new outputs
     for (int i = 0; i < num_splitter_outputs; ++i) {
-        flow.push_back(splitter_flow);
+        flow.appendRow(splitter_flow.data());
     }
     
     // Now trim the new unused inputs/outputs; start from the back so that erasing can work properly
@@ -189,53 +174,53 @@ Matrix addSplitterToFlow(Matrix flow, const Wiring splitter_inputs, const Wiring
         }
         // Check if it's an output of the splitter that's used
         int output_index = i - num_flow_outputs;
-        bool in_output_segment = output_index >= 0;
-        bool output_wired = splitter_outputs[output_index] != -1;
-        if (in_output_segment && output_wired) {
+        if (output_index >= 0 && splitter_outputs[output_index] != -1) {
             is_used = true;
         }
         if (is_used) {
-            flow.erase(flow.begin() + i);
-            continue;
+            flow.eraseRow(i);
         }
-        
-        // Now trim columns (inputs)
-        int old_row_size = flow[i].size();
-        for (int j = old_row_size - 1; j >= 0; --j) {
-            bool is_used = false;
-            // Check if it's an input of the previous network that's now an output of the splitter
-            for (int k = 0; k < num_splitter_outputs; ++k) {
-                if (splitter_outputs[k] == j) {
-                    is_used = true;
-                }
-            }
-            // Check if it's a used input of the splitter that's used
-            int input_index = num_splitter_inputs + j - old_row_size;
-            bool in_input_segment = 0 <= input_index;
-            bool input_wired = splitter_inputs[input_index] != -1;
-            if (in_input_segment && input_wired) {
+    }
+    
+    // Now trim columns (inputs)
+    for (int j = num_flow_inputs + num_splitter_inputs - 1; j >= 0; --j) {
+        bool is_used = false;
+        // Check if it's an input of the previous network that's now an output of the splitter
+        for (int k = 0; k < num_splitter_outputs; ++k) {
+            if (splitter_outputs[k] == j) {
                 is_used = true;
             }
-            if (is_used) {
-                flow[i].erase(flow[i].begin() + j);
-            }
         }
-    }
-    
-    // Keep sorting rows and columns until nothing further happens (to transform into normal form)
-    bool sorted = false;
-    while (!sorted) {
-        Matrix old_flow = flow;
-        
-        sort(flow.begin(), flow.end());
-        flow = transpose(flow);
-        sort(flow.begin(), flow.end());
-        flow = transpose(flow);
-        
-        if (flow == old_flow) {
-            sorted = true;
+        // Check if it's a used input of the splitter that's used
+        int input_index = j - num_flow_inputs;
+        if (input_index >= 0 && splitter_inputs[input_index] != -1) {
+            is_used = true;
+        }
+        if (is_used) {
+            flow.eraseColumn(j);
         }
     }
     
     return flow;
 }
+
+template <class M>
+M addSplitterToFlow(M flow, const Wiring& splitter_inputs, const Wiring& splitter_outputs) {
+    // Transform into normal form
+    return canonicalForm(attachSplitter(move(flow), splitter_inputs, splitter_outputs));
+}
+
+template Row rowAdd(const Row&, const Row&);
+template ExactRow rowAdd(const ExactRow&, const ExactRow&);
+template Row rowMultiply(Row, double);
+template ExactRow rowMultiply(ExactRow, Rational);
+template Matrix identityMatrix<Matrix>(int);
+template ExactMatrix identityMatrix<ExactMatrix>(int);
+template Row getColumn(const Matrix&, int);
+template ExactRow getColumn(const ExactMatrix&, int);
+template Matrix transpose(Matrix);
+template ExactMatrix transpose(ExactMatrix);
+template Matrix attachSplitter(Matrix, const Wiring&, const Wiring&);
+template ExactMatrix attachSplitter(ExactMatrix, const Wiring&, const Wiring&);
+template Matrix addSplitterToFlow(Matrix, const Wiring&, const Wiring&);
+template ExactMatrix addSplitterToFlow(ExactMatrix, const Wiring&, const Wiring&);
@@ -14,37 +14,58 @@ Row zeroRow(int size);
 // Generate a row with a single 1 entry
 Row oneRow(int size, int one_position);
 
+// The matrix operations below work on both Matrix (doubles) and ExactMatrix
+// (Rationals) through their template parameter. They are built on the
+// allocation-free kernels in kernels.hpp, which can also be used directly on
+// matrix rows.
+
 // Add two rows together
-Row rowAdd(Row new_row, Row input_node_row);
+template <class T>
+vector<T> rowAdd(const vector<T>& new_row, const vector<T>& input_node_row);
 
-// Multiply a row by a double
-Row rowMultiply(Row row, double multiplier);
+// Multiply a row by a scalar
+template <class T>
+vector<T> rowMultiply(vector<T> row, T multiplier);
 
 // Generate an identity matrix matrix
-Matrix identityMatrix(int size);
+template <class M = Matrix>
+M identityMatrix(int size);
 
 // Extract a column from a matrix
-Row getColumn(Matrix matrix, int column_position);
+template <class M>
+vector<typename M::value_type> getColumn(const M& matrix, int column_position);
 
-// Transpos a matrix
-Matrix transpose(Matrix matrix);
+// Transpose a matrix (in place, on the copy it's given)
+template <class M>
+M transpose(M matrix);
 
 //////////////////////////////
 // Network operations
 //////////////////////////////
 
-// Generate an empty network
+// Generate an empty network. Its nodes are allocated one by one and never
+// freed; OwnedNetwork keeps them together and frees them.
 Network emptyNetwork(int size);
 
 // Link two nodes in a network
 void link(Network& nodes, int source, int target);
 
+// Remove one link between two nodes in a network
+void unlink(Network& nodes, int source, int target);
+
 // Find a node's index in a network
-int nodeNum(Network nodes, Node* node);
+int nodeNum(const Network& nodes, Node* node);
 
 // network[i] is flow from inputs to i-th output
 // splitter_inputs has an entry of -1 for a new input that's not already part of the network
 // splitter_outputs has an entry of -1 for a new output
 // There must be at least one output
 // Network must have at least one input
-Matrix addSplitterToFlow(Matrix flow, vector<int> splitter_inputs, vector<int> splitter_outputs);
+// The result is in canonical form (see canonical_form.hpp)
+template <class M>
+M addSplitterToFlow(M flow, const Wiring& splitter_inputs, const Wiring& splitter_outputs);
+
+// addSplitterToFlow without the canonical form: the remaining old outputs and
+// inputs keep their order, followed by the splitter's new ones
+template <class M>
+M attachSplitter(M flow, const Wiring& splitter_inputs, const Wiring& splitter_outputs);
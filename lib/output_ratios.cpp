@@ -2,55 +2,131 @@
 
 #include <algorithm>
 
+#include "graph.hpp"
+#include "kernels.hpp"
 #include "network_tools.hpp"
 #include "types.hpp"
 #include "output_ratios.hpp"
 
-Matrix outputRatios(Network nodes) {
-  int network_size = nodes.size();
+template <class M>
+M sourceRatios(const Graph& graph, vector<int>* sources) {
+  using T = typename M::value_type;
 
-  Matrix flow = identityMatrix(network_size);
+  int network_size = graph.size;
 
-  // Solve the nodes in terms of others
+  // Input nodes, and which column each one gets
+  vector<int> source_column(network_size, -1);
+  vector<int> source_nodes;
   for (int i = 0; i < network_size; ++i) {
-    Node* current_node = nodes[i];
+    if (graph.inputCount(i) == 0) {
+      source_column[i] = source_nodes.size();
+      source_nodes.push_back(i);
+    }
+  }
+  int num_sources = source_nodes.size();
+
+  M flow(network_size, num_sources);
+  for (int k = 0; k < num_sources; ++k) {
+    flow[source_nodes[k]][k] = 1;
+  }
+
+  // Position of each node of the current component within it, or -1
+  vector<int> local(network_size, -1);
 
-    int node_inputs = current_node->inputs.size();
-    int node_outputs = current_node->outputs.size();
+  // Row p holds node component[p] in terms of the sources (first num_sources
+  // columns) and the component's nodes (the rest). Reused between components,
+  // so it only allocates when a component is bigger than any before it.
+  M rows;
+  vector<T> new_row;
 
-    // Do nothing for input nodes
-    if (node_inputs == 0) {
+  // Solve one strongly connected component at a time, in topological order,
+  // so every node feeding the component from outside is already solved.
+  // Within a component, nodes are eliminated in index order: each node is
+  // solved in terms of the sources and the component's nodes that haven't
+  // been solved yet, and substituted into the rows solved before it.
+  Components components = stronglyConnectedComponents(graph);
+  for (int c = 0; c < components.count(); ++c) {
+    const int* component = components.begin(c);
+    int size = components.size(c);
+    if (size == 1 && source_column[component[0]] != -1) {
       continue;
     }
+    for (int p = 0; p < size; ++p) {
+      local[component[p]] = p;
+    }
+
+    int width = num_sources + size;
+    rows.resize(size, width);
+    new_row.resize(width);
+
+    for (int p = 0; p < size; ++p) {
+      int node = component[p];
+      fill(new_row.begin(), new_row.end(), T(0));
+
+      // Sum input node rows
+      for (int e = graph.input_start[node]; e < graph.input_start[node + 1]; ++e) {
+        int input = graph.inputs[e];
+        int q = local[input];
+        if (q == -1) {
+          addInPlace(new_row.data(), flow[input], num_sources);
+        } else if (q < p) {
+          addInPlace(new_row.data(), rows[q], width);
+        } else {
+          new_row[num_sources + q] += 1;
+        }
+      }
+
+      // Divide by number of belt outputs, if any
+      T belt_normalizer = T(1) / T(max(graph.outputCount(node), 1));
+      scaleInPlace(new_row.data(), belt_normalizer, width);
 
-    // Sum input node rows
-    Row new_row = zeroRow(network_size);
-    for (auto input_node : current_node->inputs) {
-      Row input_row = flow[nodeNum(nodes, input_node)];
-      new_row = rowAdd(new_row, input_row);
+      // Update self-dependencies on this node
+      T self_flow = T(1) / (T(1) - new_row[num_sources + p]);
+      scaleAndZero(new_row.data(), self_flow, width, num_sources + p);
+
+      // Update the rows solved before this one that still depend on it
+      for (int q = 0; q < p; ++q) {
+        T backflow = rows[q][num_sources + p];
+        if (backflow == T(0)) {
+          continue;
+        }
+        axpy(rows[q], new_row.data(), backflow, width);
+        rows[q][num_sources + p] = 0;
+      }
+
+      copy(new_row.begin(), new_row.end(), rows[p]);
     }
 
-    // Divide by number of belt outputs, if any
-    double belt_normalizer = 1.0 / max(node_outputs, 1);
-    new_row = rowMultiply(new_row, belt_normalizer);
-
-    // Update self-dependencies on this node
-    double self_flow = 1 / (1 - new_row[i]);
-    new_row = rowMultiply(new_row, self_flow);
-    new_row[i] = 0;
-
-    // Update other nodes that flow to this one
-    for (int j = 0; j < network_size; ++j) {
-      // backflow is the share of i's flow that comes from j???
-      double backflow = flow[j][i];
-      flow[j] = rowAdd(flow[j], rowMultiply(new_row, backflow));
-      // clear back-pressure
-      flow[j][i] = 0;
+    // Every node of the component is now in terms of the sources only
+    for (int p = 0; p < size; ++p) {
+      copy(rows[p], rows[p] + num_sources, flow[component[p]]);
+      local[component[p]] = -1;
     }
+  }
 
-    // Update flow
-    flow[i] = new_row;
+  if (sources != nullptr) {
+    *sources = source_nodes;
   }
+  return flow;
+}
+
+template <class M>
+M outputRatios(const Network& nodes) {
+  int network_size = nodes.size();
 
+  vector<int> sources;
+  M source_flow = sourceRatios<M>(toGraph(nodes), &sources);
+
+  M flow(network_size, network_size);
+  for (int i = 0; i < network_size; ++i) {
+    for (int k = 0; k < sources.size(); ++k) {
+      flow[i][sources[k]] = source_flow[i][k];
+    }
+  }
   return flow;
-}
\ No newline at end of file
+}
+
+template Matrix sourceRatios<Matrix>(const Graph&, vector<int>*);
+template ExactMatrix sourceRatios<ExactMatrix>(const Graph&, vector<int>*);
+template Matrix outputRatios<Matrix>(const Network&);
+template ExactMatrix outputRatios<ExactMatrix>(const Network&);
@@ -2,6 +2,7 @@
 
 #pragma once
 
+#include "graph.hpp"
 #include "types.hpp"
 
 // Find the ratios given by a certain splitter network (as a double).
@@ -10,4 +11,13 @@
 // node i's output that depends  on node j's output. Eventually, we want to
 // reduce everything to dependencies on the inputs. Initially, this will just be
 // the trivial "this splitter outputs what it outputs" vector.
-Matrix outputRatios(Network nodes);
\ No newline at end of file
+// Pass ExactMatrix as M to get exact fractions instead of doubles.
+template <class M = Matrix>
+M outputRatios(const Network& nodes);
+
+// The same ratios with only the input nodes (nodes without inputs) as columns:
+// the [i][k] entry is the amount of node i's output that comes from input node
+// sources[k]. Loops are solved one strongly connected component at a time, so
+// loop-free parts of the network take time linear in their links.
+template <class M = Matrix>
+M sourceRatios(const Graph& graph, vector<int>* sources = nullptr);
@@ -0,0 +1,246 @@
+// Seeded random splitter networks, and corpora of them on disk
+
+#include <cstring>
+
+#include "hashing.hpp"
+#include "network_tools.hpp"
+#include "random_network.hpp"
+
+namespace {
+
+const char corpus_magic[8] = {'B', 'A', 'L', 'N', 'E', 'T', 'S', 0};
+const uint32_t corpus_version = 1;
+
+// Splitters back a loop can go
+const int loop_window = 8;
+
+struct CorpusHeader {
+  char magic[8];
+  uint32_t version;
+  uint32_t reserved;
+  uint64_t networks;
+};
+
+struct CorpusRecord {
+  int32_t num_nodes;
+  int32_t num_inputs;
+  int32_t num_outputs;
+  uint32_t links;
+  uint64_t seed;
+  double loop_fraction;
+};
+
+// splitmix64, so the networks don't depend on the standard library's distributions
+class Random {
+ public:
+  explicit Random(uint64_t seed) : state(seed) {}
+
+  uint64_t next() {
+    uint64_t x = state;
+    state += 0x9e3779b97f4a7c15ull;
+    return mix64(x);
+  }
+
+  // In [0, bound)
+  int below(int bound) { return (int)(next() % (uint64_t)bound); }
+
+  // True with this chance
+  bool chance(double p) { return (next() >> 11) * 0x1.0p-53 < p; }
+
+ private:
+  uint64_t state;
+};
+
+// One way to wire the next splitter
+struct Choice {
+  int inputs;
+  int outputs;
+  bool loop;
+};
+
+}  // namespace
+
+vector<pair<int, int>> randomLinks(const RandomNetworkSpec& spec) {
+  int num_splitters = spec.num_nodes - spec.num_inputs - spec.num_outputs;
+  if (spec.num_inputs < 1 || spec.num_outputs < 1 || num_splitters < 0 ||
+      abs(spec.num_inputs - spec.num_outputs) > num_splitters ||
+      (num_splitters == 0 && spec.num_inputs != spec.num_outputs)) {
+    throw "No network fits the spec";
+  }
+
+  Random random(spec.seed);
+  vector<pair<int, int>> links;
+  links.reserve(spec.num_nodes * 2);
+
+  // Outputs not linked to anything yet, by the node they come out of
+  vector<int> free_outputs;
+  for (int i = 0; i < spec.num_inputs; ++i) {
+    free_outputs.push_back(i);
+  }
+  auto take_free_output = [&]() {
+    int k = random.below(free_outputs.size());
+    int node = free_outputs[k];
+    free_outputs[k] = free_outputs.back();
+    free_outputs.pop_back();
+    return node;
+  };
+
+  // Recent splitters with only one input so far, which a loop can go back to
+  vector<int> open_inputs;
+
+  vector<Choice> choices;
+  for (int s = 0; s < num_splitters; ++s) {
+    int splitter = spec.num_inputs + s;
+    int left = num_splitters - s - 1;
+    int available = free_outputs.size();
+
+    // Keep enough free outputs to feed the next splitter, and few enough
+    // extra or missing ones that the splitters left can make up the difference
+    choices.clear();
+    for (int inputs = 1; inputs <= 2; ++inputs) {
+      for (int outputs = 1; outputs <= 2; ++outputs) {
+        for (bool loop : {false, true}) {
+          // A loop needs a second output, and a splitter to go back to: one
+          // before, or this one if it has an input to spare
+          if (loop && (outputs != 2 || (open_inputs.empty() && inputs != 1))) {
+            continue;
+          }
+          int after = available - inputs + outputs - loop;
+          if (inputs <= available && after >= 1 && abs(after - spec.num_outputs) <= left) {
+            choices.push_back({inputs, outputs, loop});
+          }
+        }
+      }
+    }
+    // Loops only as often as asked for
+    bool want_loop = random.chance(spec.loop_fraction);
+    vector<Choice> preferred;
+    for (const Choice& choice : choices) {
+      if (choice.loop == want_loop) {
+        preferred.push_back(choice);
+      }
+    }
+    const vector<Choice>& from = preferred.empty() ? choices : preferred;
+    Choice choice = from[random.below(from.size())];
+
+    for (int i = 0; i < choice.inputs; ++i) {
+      links.push_back({take_free_output(), splitter});
+    }
+    if (choice.inputs == 1) {
+      open_inputs.push_back(splitter);
+    }
+    if (choice.loop) {
+      int first = max(0, (int)open_inputs.size() - loop_window);
+      int k = first + random.below(open_inputs.size() - first);
+      links.push_back({splitter, open_inputs[k]});
+      open_inputs.erase(open_inputs.begin() + k);
+    }
+    for (int i = choice.loop; i < choice.outputs; ++i) {
+      free_outputs.push_back(splitter);
+    }
+  }
+
+  // What's left over goes to the output nodes, in random order
+  int first_output = spec.num_nodes - spec.num_outputs;
+  for (int i = 0; i < spec.num_outputs; ++i) {
+    links.push_back({take_free_output(), first_output + i});
+  }
+  return links;
+}
+
+OwnedNetwork randomNetwork(const RandomNetworkSpec& spec) {
+  vector<pair<int, int>> links = randomLinks(spec);
+  OwnedNetwork network(spec.num_nodes);
+  for (const pair<int, int>& network_link : links) {
+    link(network, network_link.first, network_link.second);
+  }
+  return network;
+}
+
+void writeNetworkCorpus(const string& path, const vector<RandomNetworkSpec>& specs) {
+  // Replace any old corpus only once the new one is whole
+  string temporary_path = path + ".tmp";
+  FILE* file = fopen(temporary_path.c_str(), "wb");
+  if (file == nullptr) {
+    throw "Can't write network corpus";
+  }
+
+  CorpusHeader header = {};
+  memcpy(header.magic, corpus_magic, sizeof(corpus_magic));
+  header.version = corpus_version;
+  header.networks = specs.size();
+  bool written = fwrite(&header, sizeof(header), 1, file) == 1;
+
+  vector<uint32_t> packed;
+  for (int n = 0; n < specs.size() && written; ++n) {
+    const RandomNetworkSpec& spec = specs[n];
+    vector<pair<int, int>> links;
+    try {
+      links = randomLinks(spec);
+    } catch (const char*) {
+      fclose(file);
+      remove(temporary_path.c_str());
+      throw;
+    }
+    CorpusRecord record = {spec.num_nodes, spec.num_inputs, spec.num_outputs, (uint32_t)links.size(), spec.seed,
+                           spec.loop_fraction};
+    packed.clear();
+    for (const pair<int, int>& network_link : links) {
+      packed.push_back(network_link.first);
+      packed.push_back(network_link.second);
+    }
+    written = fwrite(&record, sizeof(record), 1, file) == 1 &&
+              fwrite(packed.data(), sizeof(packed[0]), packed.size(), file) == packed.size();
+  }
+
+  written = fclose(file) == 0 && written;
+  if (!written || rename(temporary_path.c_str(), path.c_str()) != 0) {
+    throw "Can't write network corpus";
+  }
+}
+
+NetworkCorpusReader::NetworkCorpusReader(const string& path) {
+  file = fopen(path.c_str(), "rb");
+  if (file == nullptr) {
+    throw "Can't open network corpus";
+  }
+  CorpusHeader header;
+  if (fread(&header, sizeof(header), 1, file) != 1 || memcmp(header.magic, corpus_magic, sizeof(corpus_magic)) != 0) {
+    fclose(file);
+    throw "Not a network corpus";
+  }
+  if (header.version != corpus_version) {
+    fclose(file);
+    throw "Unsupported network corpus version";
+  }
+  num_networks = header.networks;
+}
+
+NetworkCorpusReader::~NetworkCorpusReader() {
+  fclose(file);
+}
+
+bool NetworkCorpusReader::next(RandomNetworkSpec& spec, OwnedNetwork& network) {
+  if (num_read == num_networks) {
+    return false;
+  }
+  CorpusRecord record;
+  if (fread(&record, sizeof(record), 1, file) != 1) {
+    throw "Network corpus is truncated";
+  }
+  vector<uint32_t> packed(2 * (size_t)record.links);
+  if (fread(packed.data(), sizeof(packed[0]), packed.size(), file) != packed.size()) {
+    throw "Network corpus is truncated";
+  }
+
+  spec = {record.num_nodes, record.num_inputs, record.num_outputs, record.seed, record.loop_fraction};
+  network = OwnedNetwork(record.num_nodes);
+  for (size_t k = 0; k < packed.size(); k += 2) {
+    if (packed[k] >= record.num_nodes || packed[k + 1] >= record.num_nodes) {
+      throw "Network corpus has a link to a node that isn't there";
+    }
+    link(network, packed[k], packed[k + 1]);
+  }
+  ++num_read;
+  return true;
+}
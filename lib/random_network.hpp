@@ -0,0 +1,61 @@
+// Seeded random splitter networks, and corpora of them on disk
+
+#pragma once
+
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <utility>
+
+#include "types.hpp"
+
+// What to generate: num_nodes nodes in all, of which num_inputs input nodes
+// (no inputs, one output) come first and num_outputs output nodes (one input,
+// no outputs) come last. The splitters between them have one or two inputs
+// and one or two outputs.
+struct RandomNetworkSpec {
+  int num_nodes;
+  int num_inputs;
+  int num_outputs;
+  uint64_t seed;
+  // Chance that a splitter with two outputs sends one of them back to one of
+  // the few splitters before it (or to itself), making a loop
+  double loop_fraction = 0.1;
+};
+
+// The links of a random network, as (source, target) node pairs. Splitters
+// are wired in order, each fed from outputs left free by the ones before it,
+// and every splitter keeps an output that leads on towards a later node, so
+// every loop has a way out and outputRatios can solve it. The same spec
+// always gives the same links. Throws if no network fits the spec.
+vector<pair<int, int>> randomLinks(const RandomNetworkSpec& spec);
+
+// The network of randomLinks(spec)
+OwnedNetwork randomNetwork(const RandomNetworkSpec& spec);
+
+// Generate a network for each spec and write them one by one to a corpus file
+// at path, so the corpus can be bigger than memory. Format (version 1, native
+// byte order): a header, then for each network its spec, its link count, and
+// its links as pairs of uint32s.
+void writeNetworkCorpus(const string& path, const vector<RandomNetworkSpec>& specs);
+
+// Reads the networks of a corpus file one at a time
+class NetworkCorpusReader {
+ public:
+  explicit NetworkCorpusReader(const string& path);
+  ~NetworkCorpusReader();
+
+  NetworkCorpusReader(const NetworkCorpusReader&) = delete;
+  NetworkCorpusReader& operator=(const NetworkCorpusReader&) = delete;
+
+  // Read the next network and its spec; returns false at the end of the file
+  bool next(RandomNetworkSpec& spec, OwnedNetwork& network);
+
+  // Networks in the corpus
+  size_t size() const { return num_networks; }
+
+ private:
+  FILE* file;
+  size_t num_networks;
+  size_t num_read = 0;
+};
@@ -0,0 +1,89 @@
+// Exact fractions for flow arithmetic
+
+#pragma once
+
+#include <cstdint>
+
+// A fraction of two int64s, always stored in lowest terms with a positive
+// denominator, so equal values have equal fields and can be compared and
+// hashed as integers. Intermediate products are taken in 128 bits; a result
+// that doesn't fit in 64 bits throws.
+struct Rational {
+  int64_t num = 0;
+  int64_t den = 1;
+
+  Rational() {}
+  Rational(int64_t value) : num(value) {}
+  Rational(int64_t numerator, int64_t denominator) {
+    *this = reduce(numerator, denominator);
+  }
+
+  double toDouble() const { return (double)num / den; }
+
+  friend Rational operator+(Rational a, Rational b) {
+    return reduce((__int128)a.num * b.den + (__int128)b.num * a.den, (__int128)a.den * b.den);
+  }
+
+  friend Rational operator-(Rational a, Rational b) {
+    return reduce((__int128)a.num * b.den - (__int128)b.num * a.den, (__int128)a.den * b.den);
+  }
+
+  friend Rational operator*(Rational a, Rational b) {
+    return reduce((__int128)a.num * b.num, (__int128)a.den * b.den);
+  }
+
+  friend Rational operator/(Rational a, Rational b) {
+    if (b.num == 0) {
+      throw "Division by zero";
+    }
+    return reduce((__int128)a.num * b.den, (__int128)a.den * b.num);
+  }
+
+  Rational& operator+=(Rational other) { return *this = *this + other; }
+  Rational& operator-=(Rational other) { return *this = *this - other; }
+  Rational& operator*=(Rational other) { return *this = *this * other; }
+  Rational& operator/=(Rational other) { return *this = *this / other; }
+
+  friend bool operator==(Rational a, Rational b) { return a.num == b.num && a.den == b.den; }
+  friend bool operator!=(Rational a, Rational b) { return !(a == b); }
+  friend bool operator<(Rational a, Rational b) {
+    return (__int128)a.num * b.den < (__int128)b.num * a.den;
+  }
+  friend bool operator>(Rational a, Rational b) { return b < a; }
+  friend bool operator<=(Rational a, Rational b) { return !(b < a); }
+  friend bool operator>=(Rational a, Rational b) { return !(a < b); }
+
+ private:
+  static __int128 gcd(__int128 a, __int128 b) {
+    a = a < 0 ? -a : a;
+    b = b < 0 ? -b : b;
+    while (b != 0) {
+      __int128 t = a % b;
+      a = b;
+      b = t;
+    }
+    return a;
+  }
+
+  static Rational reduce(__int128 numerator, __int128 denominator) {
+    if (denominator == 0) {
+      throw "Division by zero";
+    }
+    if (denominator < 0) {
+      numerator = -numerator;
+      denominator = -denominator;
+    }
+    __int128 divisor = gcd(numerator, denominator);
+    if (divisor > 1) {
+      numerator /= divisor;
+      denominator /= divisor;
+    }
+    if (numerator > INT64_MAX || numerator < -INT64_MAX || denominator > INT64_MAX) {
+      throw "Rational overflow";
+    }
+    Rational result;
+    result.num = (int64_t)numerator;
+    result.den = (int64_t)denominator;
+    return result;
+  }
+};
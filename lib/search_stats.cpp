@@ -0,0 +1,35 @@
+// Counters and timings of the balancer search, for finding where it spends its time
+
+#include "search_stats.hpp"
+
+LevelStats& LevelStats::operator+=(const LevelStats& other) {
+  level = other.level;
+  expanded += other.expanded;
+  new_flows += other.new_flows;
+  configs += other.configs;
+  pruned += other.pruned;
+  duplicates += other.duplicates;
+  counters += other.counters;
+  seconds += other.seconds;
+  return *this;
+}
+
+LevelStats SearchStats::total() const {
+  LevelStats sum;
+  for (const LevelStats& level : levels) {
+    sum += level;
+  }
+  return sum;
+}
+
+string formatLevelStats(const LevelStats& level) {
+  string line = "level " + to_string(level.level) + ": " + to_string(level.expanded) + " expanded, " +
+                to_string(level.new_flows) + " new, " + to_string(level.seconds * 1e3) + " ms";
+  if (search_stats_enabled) {
+    line += "; " + to_string(level.configs) + " configs, " + to_string(level.counters.circular) + " circular, " +
+            to_string(level.pruned) + " pruned, " + to_string(level.duplicates) + " duplicates, " +
+            to_string(level.counters.refinement_passes) + " refinement passes, " +
+            to_string(level.counters.labelings) + " labelings";
+  }
+  return line;
+}
@@ -0,0 +1,82 @@
+// Counters and timings of the balancer search, for finding where it spends its time
+
+#pragma once
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+// Build with -DSEARCH_STATS to count what the search does config by config.
+// Without it the counting compiles away, and LevelStats only has what the
+// search knows anyway: flows expanded and found, and each level's time.
+#ifdef SEARCH_STATS
+constexpr bool search_stats_enabled = true;
+#else
+constexpr bool search_stats_enabled = false;
+#endif
+
+// Counts made inside validConfigs and canonicalForm, kept per thread
+struct SearchCounters {
+  // Configs validConfigs dropped because they made a loop with no way out
+  size_t circular = 0;
+  // Colour refinement passes over the rows or columns of a flow
+  size_t refinement_passes = 0;
+  // Leaves of the individualization tree, i.e. full labelings compared
+  size_t labelings = 0;
+
+  SearchCounters& operator+=(const SearchCounters& other) {
+    circular += other.circular;
+    refinement_passes += other.refinement_passes;
+    labelings += other.labelings;
+    return *this;
+  }
+
+  SearchCounters operator-(const SearchCounters& other) const {
+    return {circular - other.circular, refinement_passes - other.refinement_passes, labelings - other.labelings};
+  }
+};
+
+// This thread's counters, which only ever go up
+inline SearchCounters& threadSearchCounters() {
+  static thread_local SearchCounters counters;
+  return counters;
+}
+
+// Add to one of this thread's counters, if counting is compiled in
+inline void countSearchStat(size_t SearchCounters::*counter, size_t count = 1) {
+  if constexpr (search_stats_enabled) {
+    threadSearchCounters().*counter += count;
+  }
+}
+
+// What one level of a search did
+struct LevelStats {
+  // Splitters placed once the level is done
+  int level = 0;
+  // Frontier flows expanded, and the new flows they made
+  size_t expanded = 0;
+  size_t new_flows = 0;
+  // Only counted with SEARCH_STATS: configs tried, the ones prune skipped,
+  // and addSplitterToFlow results that had already been found
+  size_t configs = 0;
+  size_t pruned = 0;
+  size_t duplicates = 0;
+  SearchCounters counters;
+  double seconds = 0;
+
+  LevelStats& operator+=(const LevelStats& other);
+};
+
+// Every level a search expanded, in order. A resumed search only has the
+// levels it did itself, the first maybe only partly.
+struct SearchStats {
+  vector<LevelStats> levels;
+
+  // Every level added up; level is the last one's
+  LevelStats total() const;
+};
+
+// One line about a level, for logging
+string formatLevelStats(const LevelStats& level);
@@ -0,0 +1,126 @@
+// Work-stealing thread pool for spreading the balancer search across cores
+
+#include <algorithm>
+
+#include "thread_pool.hpp"
+
+ThreadPool::ThreadPool(int threads) {
+  if (threads <= 0) {
+    threads = max(1u, std::thread::hardware_concurrency());
+  }
+  for (int i = 0; i < threads; ++i) {
+    queues.push_back(make_unique<Queue>());
+  }
+  for (int i = 1; i < threads; ++i) {
+    workers.emplace_back(&ThreadPool::workerLoop, this, i);
+  }
+}
+
+ThreadPool::~ThreadPool() {
+  {
+    lock_guard<mutex> guard(lock);
+    stopping = true;
+  }
+  start.notify_all();
+  for (std::thread& worker : workers) {
+    worker.join();
+  }
+}
+
+void ThreadPool::parallelFor(int count, const function<void(int, int)>& loop_body) {
+  if (count <= 0) {
+    return;
+  }
+
+  // About eight ranges per thread: enough to even out uneven work by
+  // stealing, few enough that taking a range is cheap next to running it
+  int range_size = max(1, count / (8 * threads()));
+  int next_queue = 0;
+  for (int begin = 0; begin < count; begin += range_size) {
+    Queue& queue = *queues[next_queue];
+    lock_guard<mutex> guard(queue.lock);
+    queue.ranges.push_back({begin, min(count, begin + range_size)});
+    next_queue = (next_queue + 1) % threads();
+  }
+
+  {
+    lock_guard<mutex> guard(lock);
+    body = &loop_body;
+    workers_done = 0;
+    error = nullptr;
+    ++generation;
+  }
+  start.notify_all();
+
+  drain(0);
+
+  unique_lock<mutex> guard(lock);
+  finished.wait(guard, [&] { return workers_done == (int)workers.size(); });
+  body = nullptr;
+  if (error) {
+    rethrow_exception(error);
+  }
+}
+
+void ThreadPool::workerLoop(int thread) {
+  int seen_generation = 0;
+  while (true) {
+    {
+      unique_lock<mutex> guard(lock);
+      start.wait(guard, [&] { return stopping || generation != seen_generation; });
+      if (stopping) {
+        return;
+      }
+      seen_generation = generation;
+    }
+
+    drain(thread);
+
+    {
+      lock_guard<mutex> guard(lock);
+      ++workers_done;
+    }
+    finished.notify_one();
+  }
+}
+
+void ThreadPool::drain(int thread) {
+  pair<int, int> range;
+  while (takeRange(thread, range)) {
+    try {
+      for (int i = range.first; i < range.second; ++i) {
+        (*body)(thread, i);
+      }
+    } catch (...) {
+      lock_guard<mutex> guard(lock);
+      if (!error) {
+        error = current_exception();
+      }
+    }
+  }
+}
+
+bool ThreadPool::takeRange(int thread, pair<int, int>& range) {
+  // Own queue first, from the front
+  {
+    Queue& queue = *queues[thread];
+    lock_guard<mutex> guard(queue.lock);
+    if (!queue.ranges.empty()) {
+      range = queue.ranges.front();
+      queue.ranges.pop_front();
+      return true;
+    }
+  }
+
+  // Then steal from the back of the other queues
+  for (int k = 1; k < threads(); ++k) {
+    Queue& queue = *queues[(thread + k) % threads()];
+    lock_guard<mutex> guard(queue.lock);
+    if (!queue.ranges.empty()) {
+      range = queue.ranges.back();
+      queue.ranges.pop_back();
+      return true;
+    }
+  }
+  return false;
+}
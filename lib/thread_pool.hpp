@@ -0,0 +1,61 @@
+// Work-stealing thread pool for spreading the balancer search across cores
+
+#pragma once
+
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
+
+using namespace std;
+
+// A fixed set of worker threads that run parallelFor loops. Each loop is cut
+// into small ranges that are dealt out to per-thread queues; a thread works
+// through its own queue from the front and, once it runs dry, steals ranges
+// from the back of the others. The calling thread takes part as thread 0.
+class ThreadPool {
+ public:
+  // threads <= 0 uses one thread per hardware core
+  explicit ThreadPool(int threads);
+  ~ThreadPool();
+
+  ThreadPool(const ThreadPool&) = delete;
+  ThreadPool& operator=(const ThreadPool&) = delete;
+
+  int threads() const { return queues.size(); }
+
+  // Call body(thread, i) for every i in [0, count) and wait for all of them.
+  // thread is the index of the thread making the call, in [0, threads()).
+  // If any call throws, the first exception is rethrown here once the loop
+  // has finished.
+  void parallelFor(int count, const function<void(int, int)>& body);
+
+ private:
+  struct Queue {
+    mutex lock;
+    deque<pair<int, int>> ranges;
+  };
+
+  void workerLoop(int thread);
+  // Run ranges until every queue is empty
+  void drain(int thread);
+  bool takeRange(int thread, pair<int, int>& range);
+
+  vector<unique_ptr<Queue>> queues;
+  vector<std::thread> workers;
+
+  mutex lock;
+  condition_variable start;
+  condition_variable finished;
+  const function<void(int, int)>* body = nullptr;
+  // Bumped for every parallelFor, so workers can tell a new loop has started
+  int generation = 0;
+  int workers_done = 0;
+  bool stopping = false;
+  exception_ptr error;
+};
@@ -0,0 +1,302 @@
+// Throughput limits of splitter networks, by max flow over belts
+
+#include <algorithm>
+#include <atomic>
+#include <memory>
+#include <mutex>
+
+#include "thread_pool.hpp"
+#include "throughput.hpp"
+
+namespace {
+
+// Input sets each thread takes at a time
+const int sets_per_run = 16;
+
+// Max flow with unit capacities from a set of source nodes to a set of sink
+// nodes of a graph, kept up to date as single sources and sinks are switched
+// on and off. Every link of the graph is an edge of capacity 1; a super source
+// feeds each switched-on source and each switched-on sink feeds a super sink.
+// Edges come in pairs, e and e ^ 1, the even one the forward edge and the odd
+// one its reverse; residual[e] is how much more can go along e.
+class UnitFlow {
+ public:
+  UnitFlow(const Graph& graph, const vector<int>& sources, const vector<int>& sinks)
+      : super_source(graph.size), super_sink(graph.size + 1), size(graph.size + 2) {
+    vector<pair<int, int>> links;
+    for (int node = 0; node < graph.size; ++node) {
+      for (int e = graph.output_start[node]; e < graph.output_start[node + 1]; ++e) {
+        links.push_back({node, graph.outputs[e]});
+      }
+    }
+    for (int source : sources) {
+      source_edges.push_back(links.size() * 2);
+      links.push_back({super_source, source});
+    }
+    for (int sink : sinks) {
+      sink_edges.push_back(links.size() * 2);
+      links.push_back({sink, super_sink});
+    }
+
+    // Both directions of every edge in each node's list
+    vector<int> counts(size + 1, 0);
+    for (const pair<int, int>& edge : links) {
+      ++counts[edge.first + 1];
+      ++counts[edge.second + 1];
+    }
+    for (int node = 0; node < size; ++node) {
+      counts[node + 1] += counts[node];
+    }
+    edge_start = counts;
+    adjacent.resize(links.size() * 2);
+    to.resize(links.size() * 2);
+    for (int k = 0; k < links.size(); ++k) {
+      to[2 * k] = links[k].second;
+      to[2 * k + 1] = links[k].first;
+      adjacent[counts[links[k].first]++] = 2 * k;
+      adjacent[counts[links[k].second]++] = 2 * k + 1;
+    }
+    original.assign(links.size() * 2, 0);
+    for (int k = 0; k < links.size() - sources.size() - sinks.size(); ++k) {
+      original[2 * k] = 1;
+    }
+    residual = original;
+
+    parent_edge.resize(size);
+    seen.assign(size, 0);
+  }
+
+  int value() const { return flow; }
+
+  // No flow, and every source and sink off
+  void reset() {
+    for (int e : source_edges) {
+      original[e] = 0;
+    }
+    for (int e : sink_edges) {
+      original[e] = 0;
+    }
+    residual = original;
+    flow = 0;
+  }
+
+  void setSource(int k, bool on) { setTerminal(source_edges[k], on, true); }
+  void setSink(int k, bool on) { setTerminal(sink_edges[k], on, false); }
+
+ private:
+  // Switch the edge from the super source (or to the super sink) on or off
+  void setTerminal(int e, bool on, bool is_source) {
+    if (on) {
+      original[e] = 1;
+      residual[e] = 1;
+      flow += augment();
+      return;
+    }
+    // Take back the unit going along it, if there is one, and see whether
+    // another source or sink can use the room that leaves
+    bool carried = residual[e ^ 1] > 0;
+    if (carried) {
+      int start = is_source ? to[e] : to[e ^ 1];
+      cancelPath(start, is_source);
+      residual[e ^ 1] = 0;
+      --flow;
+    }
+    original[e] = 0;
+    residual[e] = 0;
+    if (carried) {
+      flow += augment();
+    }
+  }
+
+  // Find a shortest path with room from the super source to the super sink
+  // and send a unit along it; returns the units sent
+  int augment() {
+    ++stamp;
+    queue.clear();
+    queue.push_back(super_source);
+    seen[super_source] = stamp;
+    for (int head = 0; head < queue.size(); ++head) {
+      int node = queue[head];
+      for (int k = edge_start[node]; k < edge_start[node + 1]; ++k) {
+        int e = adjacent[k];
+        int next = to[e];
+        if (residual[e] > 0 && seen[next] != stamp) {
+          seen[next] = stamp;
+          parent_edge[next] = e;
+          if (next == super_sink) {
+            for (int at = super_sink; at != super_source; at = to[parent_edge[at] ^ 1]) {
+              --residual[parent_edge[at]];
+              ++residual[parent_edge[at] ^ 1];
+            }
+            return 1;
+          }
+          queue.push_back(next);
+        }
+      }
+    }
+    return 0;
+  }
+
+  // Take a unit of flow off a path from start on to the super sink (forward)
+  // or from the super source up to start (backward), along edges that carry
+  // flow. The terminal edge at start is left to the caller.
+  void cancelPath(int start, bool forward) {
+    int goal = forward ? super_sink : super_source;
+    ++stamp;
+    stack.clear();
+    stack.push_back(start);
+    seen[start] = stamp;
+    while (!stack.empty()) {
+      int node = stack.back();
+      stack.pop_back();
+      if (node == goal) {
+        break;
+      }
+      for (int k = edge_start[node]; k < edge_start[node + 1]; ++k) {
+        int e = adjacent[k];
+        // Forward, an edge out of node that carries flow; backward, the
+        // reverse of an edge into node that does
+        bool carries = forward ? (e % 2 == 0 && residual[e ^ 1] > 0) : (e % 2 == 1 && residual[e] > 0);
+        int next = to[e];
+        if (carries && seen[next] != stamp) {
+          seen[next] = stamp;
+          parent_edge[next] = e;
+          stack.push_back(next);
+        }
+      }
+    }
+    for (int at = goal; at != start; at = to[parent_edge[at] ^ 1]) {
+      int e = parent_edge[at];
+      int forward_edge = forward ? e : e ^ 1;
+      ++residual[forward_edge];
+      --residual[forward_edge ^ 1];
+    }
+  }
+
+  int super_source;
+  int super_sink;
+  int size;
+  int flow = 0;
+  vector<int> source_edges;
+  vector<int> sink_edges;
+
+  vector<int> edge_start;
+  vector<int> adjacent;
+  vector<int> to;
+  vector<int> original;
+  vector<int> residual;
+
+  // Scratch space for the searches
+  vector<int> parent_edge;
+  vector<int> seen;
+  int stamp = 0;
+  vector<int> queue;
+  vector<int> stack;
+};
+
+// Every k-element subset of n things as a bit mask, in binary reflected Gray
+// code order, where each one differs from the one before by swapping a
+// single element for another
+vector<uint32_t> grayCodeSubsets(int n, int k) {
+  vector<uint32_t> subsets;
+  for (uint32_t i = 0; i < (1u << n); ++i) {
+    uint32_t gray = i ^ (i >> 1);
+    if (__builtin_popcount(gray) == k) {
+      subsets.push_back(gray);
+    }
+  }
+  return subsets;
+}
+
+// Switch on or off what changes between two subsets: off first, so the flow
+// never has more sources or sinks than it will be checked with
+template <class Set>
+void changeSubset(uint32_t from, uint32_t to, Set set) {
+  for (uint32_t off = from & ~to; off != 0; off &= off - 1) {
+    set(__builtin_ctz(off), false);
+  }
+  for (uint32_t on = to & ~from; on != 0; on &= on - 1) {
+    set(__builtin_ctz(on), true);
+  }
+}
+
+vector<int> subsetNodes(uint32_t subset, const vector<int>& nodes) {
+  vector<int> chosen;
+  for (int k = 0; k < nodes.size(); ++k) {
+    if (subset >> k & 1) {
+      chosen.push_back(nodes[k]);
+    }
+  }
+  return chosen;
+}
+
+}  // namespace
+
+bool isThroughputUnlimited(const Graph& graph, ThroughputLimit* limit, ThroughputOptions options) {
+  vector<int> inputs, outputs;
+  for (int node = 0; node < graph.size; ++node) {
+    if (graph.inputCount(node) == 0) {
+      inputs.push_back(node);
+    }
+    if (graph.outputCount(node) == 0) {
+      outputs.push_back(node);
+    }
+  }
+  if (inputs.size() > 24 || outputs.size() > 24) {
+    throw "Too many inputs or outputs for a throughput check";
+  }
+  int max_set_size = min(inputs.size(), outputs.size());
+  if (options.max_set_size > 0) {
+    max_set_size = min(max_set_size, options.max_set_size);
+  }
+
+  ThreadPool pool(options.threads);
+  vector<unique_ptr<UnitFlow>> flows;
+  for (int thread = 0; thread < pool.threads(); ++thread) {
+    flows.push_back(make_unique<UnitFlow>(graph, inputs, outputs));
+  }
+  atomic<bool> limited(false);
+  mutex limit_lock;
+
+  for (int k = 1; k <= max_set_size && !limited; ++k) {
+    vector<uint32_t> input_sets = grayCodeSubsets(inputs.size(), k);
+    vector<uint32_t> output_sets = grayCodeSubsets(outputs.size(), k);
+
+    // Each thread takes runs of consecutive input sets, and goes through the
+    // output sets forwards for one input set and backwards for the next, so
+    // only one set changes from each pair to the next
+    int runs = (input_sets.size() + sets_per_run - 1) / sets_per_run;
+    pool.parallelFor(runs, [&](int thread, int run) {
+      UnitFlow& flow = *flows[thread];
+      auto set_source = [&](int k, bool on) { flow.setSource(k, on); };
+      auto set_sink = [&](int k, bool on) { flow.setSink(k, on); };
+      flow.reset();
+      uint32_t input_set = 0;
+      uint32_t output_set = 0;
+      int end = min((run + 1) * sets_per_run, (int)input_sets.size());
+      for (int a = run * sets_per_run; a < end && !limited; ++a) {
+        changeSubset(input_set, input_sets[a], set_source);
+        input_set = input_sets[a];
+        for (int step = 0; step < output_sets.size(); ++step) {
+          int b = a % 2 == 0 ? step : output_sets.size() - 1 - step;
+          changeSubset(output_set, output_sets[b], set_sink);
+          output_set = output_sets[b];
+
+          if (flow.value() < k) {
+            lock_guard<mutex> guard(limit_lock);
+            if (!limited && limit != nullptr) {
+              *limit = {subsetNodes(input_set, inputs), subsetNodes(output_set, outputs), flow.value()};
+            }
+            limited = true;
+            return;
+          }
+        }
+      }
+    });
+  }
+  return !limited;
+}
+
+bool isThroughputUnlimited(const Network& nodes, ThroughputLimit* limit, ThroughputOptions options) {
+  return isThroughputUnlimited(toGraph(nodes), limit, options);
+}
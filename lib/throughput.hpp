@@ -0,0 +1,41 @@
+// Throughput limits of splitter networks, by max flow over belts
+
+#pragma once
+
+#include "graph.hpp"
+#include "types.hpp"
+
+// A set of inputs and a set of outputs, as node indices, that the network
+// can only carry max_flow full belts between, fewer than the smaller set
+struct ThroughputLimit {
+  vector<int> inputs;
+  vector<int> outputs;
+  int max_flow;
+};
+
+// How isThroughputUnlimited checks
+struct ThroughputOptions {
+  // Threads going through the input sets; <= 0 uses every core
+  int threads = 1;
+  // If > 0, only check sets of up to this many inputs and outputs
+  int max_set_size = 0;
+};
+
+// Whether a network is throughput unlimited: with every link a belt of
+// capacity 1, any set of its input nodes (nodes without inputs) can send
+// min(|inputs|, |outputs|) belts to any set of its output nodes (nodes
+// without outputs). Only equal-sized sets need checking, since a larger set
+// of inputs or outputs carries at least what any of its subsets does. The
+// pairs of sets are visited in an order where each one swaps a single input
+// or output for another, so the max flow is updated with at most a few
+// augmenting paths each time instead of solved again. If it isn't unlimited
+// and limit is given, it gets a pair that falls short; with one thread, the
+// first in that order.
+//
+// That's sum over k of C(inputs, k) * C(outputs, k) pairs: 12869 for 8 -> 8,
+// but 6e8 for 16 -> 16, so the biggest networks take minutes per core. A
+// network that is limited usually shows it within the first few set sizes.
+bool isThroughputUnlimited(const Network& nodes, ThroughputLimit* limit = nullptr,
+                           ThroughputOptions options = ThroughputOptions());
+bool isThroughputUnlimited(const Graph& graph, ThroughputLimit* limit = nullptr,
+                           ThroughputOptions options = ThroughputOptions());
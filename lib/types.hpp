@@ -1,21 +1,84 @@
 // Datatypes and aliases
 
 #pragma once
+#include <algorithm>
+#include <memory>
+#include <memory_resource>
 #include <string>
 #include <vector>
+
+#include "matrix.hpp"
+#include "rational.hpp"
+
 using namespace std;
 
 struct Node {
-  vector<Node *> inputs;
-  vector<Node *> outputs;
+  // Allocated from the arena of the OwnedNetwork the node belongs to, if any
+  pmr::vector<Node *> inputs;
+  pmr::vector<Node *> outputs;
 };
 
 using Row = vector<double>;
-using Matrix = vector<Row>;
+using Matrix = BasicMatrix<double>;
+// Flows with exact fractions instead of doubles
+using ExactRow = vector<Rational>;
+using ExactMatrix = BasicMatrix<Rational>;
 using Network = vector<Node *>;
 
+// A network that owns its nodes. They sit next to each other in index order,
+// their links are allocated from one arena, and all of it is freed together.
+// Converts to Network, so link(), outputRatios() and the rest take it as is;
+// the nodes can't be added to or removed.
+class OwnedNetwork {
+ public:
+  explicit OwnedNetwork(int size = 0)
+      : arena(make_unique<pmr::monotonic_buffer_resource>(max(size, 1) * initial_link_bytes)) {
+    storage.reserve(size);
+    for (int i = 0; i < size; ++i) {
+      storage.push_back(Node{pmr::vector<Node *>(arena.get()), pmr::vector<Node *>(arena.get())});
+      nodes.push_back(&storage.back());
+    }
+  }
+
+  // Copies would share nodes, so only moves; those keep the nodes in place
+  OwnedNetwork(const OwnedNetwork &) = delete;
+  OwnedNetwork(OwnedNetwork &&) = default;
+  OwnedNetwork &operator=(const OwnedNetwork &) = delete;
+  OwnedNetwork &operator=(OwnedNetwork &&other) {
+    // The old links have to be freed before the arena they came from
+    if (this != &other) {
+      nodes = move(other.nodes);
+      storage = move(other.storage);
+      arena = move(other.arena);
+    }
+    return *this;
+  }
+
+  operator Network &() { return nodes; }
+  operator const Network &() const { return nodes; }
+
+  int size() const { return nodes.size(); }
+  Node *operator[](int node) const { return nodes[node]; }
+
+ private:
+  // Arena space to start with per node, enough for a few links each way
+  static const int initial_link_bytes = 8 * sizeof(Node *);
+
+  // Declared first so that it outlives the links allocated from it
+  unique_ptr<pmr::monotonic_buffer_resource> arena;
+  vector<Node> storage;
+  Network nodes;
+};
+
+// A splitter's inputs or outputs; -1 is a new input/output, anything else is
+// the flow output/input it is wired to
+using Wiring = vector<int>;
+// {splitter inputs, splitter outputs}
+using Config = vector<Wiring>;
+using Configs = vector<Config>;
+
 struct TestNet {
   string name;
-  Network network;
+  OwnedNetwork network;
   Row ratios;
 };
\ No newline at end of file
@@ -27,7 +27,7 @@ inline void log(std::vector<double> row) {
 
 // Throw exception if index is out of bounds of vector
 template <class T>
-inline void vectorGuard(std::vector<T> v, int index) {
+inline void vectorGuard(const std::vector<T>& v, int index) {
   if (index < 0 || index > v.size()) {
     throw "Index out of bounds";
   }
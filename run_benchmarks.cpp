@@ -0,0 +1,813 @@
+// Call the benchmarks
+
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <filesystem>
+#include <iostream>
+#include <map>
+#include <new>
+#include <set>
+#include <string>
+
+#include "lib/balancer_database.hpp"
+#include "lib/canonical_form.hpp"
+#include "lib/checkpoint.hpp"
+#include "lib/dynamic_flow.hpp"
+#include "lib/exists_balancer.hpp"
+#include "lib/flow_batch.hpp"
+#include "lib/flow_runs.hpp"
+#include "lib/meet_in_the_middle.hpp"
+#include "lib/network_tools.hpp"
+#include "lib/output_ratios.hpp"
+#include "lib/random_network.hpp"
+#include "lib/throughput.hpp"
+#include "lib/utils.hpp"
+#include "tests/test_cases.hpp"
+
+using Clock = chrono::steady_clock;
+
+// Count every heap allocation the program makes. Every form of new and
+// delete is replaced, array and aligned ones included, so each pointer is
+// freed by the same pair of functions that allocated it.
+static size_t allocations = 0;
+
+static void* countedAlloc(size_t size) {
+    ++allocations;
+    if (void* memory = malloc(size)) {
+        return memory;
+    }
+    throw bad_alloc();
+}
+
+// The default memory resource of pmr containers allocates with an alignment
+static void* countedAlignedAlloc(size_t size, align_val_t alignment) {
+    ++allocations;
+    size_t align = (size_t)alignment;
+    if (void* memory = aligned_alloc(align, (size + align - 1) / align * align)) {
+        return memory;
+    }
+    throw bad_alloc();
+}
+
+void* operator new(size_t size) {
+    return countedAlloc(size);
+}
+
+void* operator new[](size_t size) {
+    return countedAlloc(size);
+}
+
+void* operator new(size_t size, align_val_t alignment) {
+    return countedAlignedAlloc(size, alignment);
+}
+
+void* operator new[](size_t size, align_val_t alignment) {
+    return countedAlignedAlloc(size, alignment);
+}
+
+void operator delete(void* memory) noexcept {
+    free(memory);
+}
+
+void operator delete[](void* memory) noexcept {
+    free(memory);
+}
+
+void operator delete(void* memory, size_t) noexcept {
+    free(memory);
+}
+
+void operator delete[](void* memory, size_t) noexcept {
+    free(memory);
+}
+
+void operator delete(void* memory, align_val_t) noexcept {
+    free(memory);
+}
+
+void operator delete[](void* memory, align_val_t) noexcept {
+    free(memory);
+}
+
+void operator delete(void* memory, size_t, align_val_t) noexcept {
+    free(memory);
+}
+
+void operator delete[](void* memory, size_t, align_val_t) noexcept {
+    free(memory);
+}
+
+double secondsSince(Clock::time_point start) {
+    return chrono::duration<double>(Clock::now() - start).count();
+}
+
+// Every flow reachable with up to max_num_splitters splitters
+vector<Matrix> reachableFlows(int max_num_splitters) {
+    set<Matrix> flows = {{{1}}};
+    vector<Matrix> frontier = {{{1}}};
+    for (int i = 0; i < max_num_splitters; ++i) {
+        vector<Matrix> next_frontier;
+        for (const Matrix& flow : frontier) {
+            for (const Config& config : validConfigs(flow)) {
+                Matrix new_flow = addSplitterToFlow(flow, config[0], config[1]);
+                if (flows.insert(new_flow).second) {
+                    next_frontier.push_back(new_flow);
+                }
+            }
+        }
+        frontier = move(next_frontier);
+    }
+    return vector<Matrix>(flows.begin(), flows.end());
+}
+
+// Shuffle the rows and columns of a matrix with a small deterministic generator
+Matrix shuffled(const Matrix& matrix, uint64_t& seed) {
+    auto next = [&](int bound) {
+        seed = seed * 6364136223846793005ull + 1442695040888963407ull;
+        return (int)((seed >> 33) % bound);
+    };
+
+    vector<int> rows(matrix.rows()), cols(matrix.cols());
+    for (int i = 0; i < rows.size(); ++i) {
+        rows[i] = i;
+        swap(rows[i], rows[next(i + 1)]);
+    }
+    for (int j = 0; j < cols.size(); ++j) {
+        cols[j] = j;
+        swap(cols[j], cols[next(j + 1)]);
+    }
+
+    Matrix result(matrix.rows(), matrix.cols());
+    for (int i = 0; i < rows.size(); ++i) {
+        for (int j = 0; j < cols.size(); ++j) {
+            result[i][j] = matrix[rows[i]][cols[j]];
+        }
+    }
+    return result;
+}
+
+void bench_canonical_form() {
+    log("Canonical form vs. sort/transpose normal form:");
+
+    const int copies = 4;
+    vector<Matrix> flows = reachableFlows(4);
+    vector<Matrix> inputs;
+    uint64_t seed = 1;
+    for (const Matrix& flow : flows) {
+        for (int i = 0; i < copies; ++i) {
+            inputs.push_back(shuffled(flow, seed));
+        }
+    }
+
+    auto start = Clock::now();
+    set<Matrix> canonical;
+    for (const Matrix& input : inputs) {
+        canonical.insert(canonicalForm(input));
+    }
+    double canonical_seconds = secondsSince(start);
+
+    start = Clock::now();
+    set<Matrix> sorted;
+    for (const Matrix& input : inputs) {
+        sorted.insert(sortNormalForm(input));
+    }
+    double sorted_seconds = secondsSince(start);
+
+    log(to_string(flows.size()) + " flows, " + to_string(copies) + " shuffled copies each");
+    log("canonicalForm:  " + to_string(canonical.size()) + " distinct, " +
+        to_string(canonical_seconds / inputs.size() * 1e9) + " ns/call");
+    log("sortNormalForm: " + to_string(sorted.size()) + " distinct, " +
+        to_string(sorted_seconds / inputs.size() * 1e9) + " ns/call");
+}
+
+// A long chain of 2 -> 2 splitters, each fed by the two before it, with a
+// short loop back every few splitters
+void linkLadder(Network& nodes) {
+    for (int i = 2; i < nodes.size(); ++i) {
+        link(nodes, i - 2, i);
+        link(nodes, i - 1, i);
+        if (i % 8 == 0) {
+            link(nodes, i, i - 3);
+        }
+    }
+}
+
+OwnedNetwork ladderNetwork(int splitters) {
+    OwnedNetwork nodes(splitters + 2);
+    linkLadder(nodes);
+    return nodes;
+}
+
+void bench_output_ratios() {
+    log("Sparse solve of long splitter chains:");
+
+    for (int splitters : {1000, 10000, 100000}) {
+        OwnedNetwork nodes = ladderNetwork(splitters);
+
+        auto start = Clock::now();
+        Graph graph = toGraph(nodes);
+        double graph_seconds = secondsSince(start);
+
+        start = Clock::now();
+        vector<int> sources;
+        Matrix flow = sourceRatios(graph, &sources);
+        double solve_seconds = secondsSince(start);
+
+        log(to_string(nodes.size()) + " nodes, " + to_string(sources.size()) + " inputs: toGraph " +
+            to_string(graph_seconds * 1e3) + " ms, sourceRatios " + to_string(solve_seconds * 1e3) + " ms");
+    }
+}
+
+void bench_dynamic_flow() {
+    log("Link edits on a dynamic flow vs. solving again:");
+
+    for (int splitters : {250, 1000}) {
+        // Feed the second to last splitter back to the first, so everything but the
+        // last splitter is one loop
+        OwnedNetwork nodes = ladderNetwork(splitters);
+        link(nodes, nodes.size() - 2, 2);
+
+        auto start = Clock::now();
+        DynamicFlow<> dynamic(nodes);
+        double setup_seconds = secondsSince(start);
+
+        // Move a loop back link one splitter along, and back again
+        const int edits = 20;
+        start = Clock::now();
+        for (int i = 0; i < edits / 2; ++i) {
+            dynamic.removeLink(16, 13);
+            dynamic.addLink(16, 12);
+            dynamic.removeLink(16, 12);
+            dynamic.addLink(16, 13);
+        }
+        double edit_seconds = secondsSince(start) / (2 * edits);
+
+        start = Clock::now();
+        Matrix flow = outputRatios(dynamic.network());
+        double solve_seconds = secondsSince(start);
+
+        log(to_string(dynamic.network().size()) + " nodes: setup " + to_string(setup_seconds * 1e3) +
+            " ms, link edit " + to_string(edit_seconds * 1e3) + " ms, outputRatios " +
+            to_string(solve_seconds * 1e3) + " ms");
+    }
+}
+
+void bench_flow_batch() {
+    log("Batched vs. one-at-a-time attachSplitter on the flows of a search:");
+
+    // Group the flows reachable with 4 splitters by shape, and attach every
+    // config of the group's first flow to every flow in the group
+    map<pair<int, int>, vector<Matrix>> groups;
+    for (const Matrix& flow : reachableFlows(4)) {
+        groups[{flow.rows(), flow.cols()}].push_back(flow);
+    }
+
+    long attached = 0;
+    double scalar_seconds = 0, batch_seconds = 0, pack_seconds = 0;
+    double checksum = 0;
+    for (auto& group : groups) {
+        const vector<Matrix>& flows = group.second;
+        Configs configs = validConfigs(flows[0]);
+
+        auto start = Clock::now();
+        FlowBatch<double> batch(flows[0].rows(), flows[0].cols(), flows.size());
+        for (int lane = 0; lane < flows.size(); ++lane) {
+            batch.store(lane, flows[lane]);
+        }
+        pack_seconds += secondsSince(start);
+
+        for (const Config& config : configs) {
+            start = Clock::now();
+            for (const Matrix& flow : flows) {
+                Matrix result = attachSplitter(flow, config[0], config[1]);
+                checksum += result[0][0];
+            }
+            scalar_seconds += secondsSince(start);
+
+            start = Clock::now();
+            FlowBatch<double> result = attachSplitterBatch(batch, config[0], config[1]);
+            checksum += result(0, 0)[0];
+            batch_seconds += secondsSince(start);
+
+            attached += flows.size();
+        }
+    }
+
+    log(to_string(groups.size()) + " shapes, " + to_string(attached) + " splitters attached (checksum " +
+        to_string(checksum) + ")");
+    log("attachSplitter:      " + to_string(scalar_seconds / attached * 1e9) + " ns/flow");
+    log("attachSplitterBatch: " + to_string(batch_seconds / attached * 1e9) + " ns/flow, plus " +
+        to_string(pack_seconds * 1e3) + " ms packing");
+}
+
+void bench_allocations() {
+    log("Heap allocations per call after warm-up:");
+
+    // Network size shouldn't change the count
+    for (int splitters : {100, 300, 1000}) {
+        OwnedNetwork nodes = ladderNetwork(splitters);
+        Matrix flow = outputRatios(nodes);
+
+        const int calls = 10;
+        size_t before = allocations;
+        for (int i = 0; i < calls; ++i) {
+            flow = outputRatios(nodes);
+        }
+        log("outputRatios, " + to_string(nodes.size()) + " nodes: " +
+            to_string((double)(allocations - before) / calls));
+    }
+
+    // Warm up on every flow and config once, then count a second pass
+    vector<Matrix> flows = reachableFlows(4);
+    vector<Configs> configs;
+    for (const Matrix& flow : flows) {
+        configs.push_back(validConfigs(flow));
+    }
+    for (int pass = 0; pass < 2; ++pass) {
+        size_t before = allocations;
+        long calls = 0;
+        for (int k = 0; k < flows.size(); ++k) {
+            for (const Config& config : configs[k]) {
+                Matrix new_flow = addSplitterToFlow(flows[k], config[0], config[1]);
+                ++calls;
+            }
+        }
+        if (pass == 1) {
+            log("addSplitterToFlow, " + to_string(calls) + " calls: " +
+                to_string((double)(allocations - before) / calls));
+        }
+    }
+}
+
+void bench_owned_network() {
+    log("Owned vs. loose network nodes:");
+
+    for (int splitters : {10000, 100000}) {
+        // Build, walk and free a ladder both ways
+        size_t before = allocations;
+        auto start = Clock::now();
+        Network loose = emptyNetwork(splitters + 2);
+        linkLadder(loose);
+        double loose_build = secondsSince(start);
+        size_t loose_allocations = allocations - before;
+        start = Clock::now();
+        Graph loose_graph = toGraph(loose);
+        double loose_walk = secondsSince(start);
+        start = Clock::now();
+        for (Node* node : loose) {
+            delete node;
+        }
+        double loose_free = secondsSince(start);
+
+        before = allocations;
+        start = Clock::now();
+        OwnedNetwork owned = ladderNetwork(splitters);
+        double owned_build = secondsSince(start);
+        size_t owned_allocations = allocations - before;
+        start = Clock::now();
+        Graph owned_graph = toGraph(owned);
+        double owned_walk = secondsSince(start);
+        start = Clock::now();
+        owned = OwnedNetwork();
+        double owned_free = secondsSince(start);
+
+        log(to_string(splitters + 2) + " nodes, build/toGraph/free: loose " + to_string(loose_build * 1e3) + "/" +
+            to_string(loose_walk * 1e3) + "/" + to_string(loose_free * 1e3) + " ms, " +
+            to_string(loose_allocations) + " allocations; owned " + to_string(owned_build * 1e3) + "/" +
+            to_string(owned_walk * 1e3) + "/" + to_string(owned_free * 1e3) + " ms, " +
+            to_string(owned_allocations) + " allocations");
+    }
+}
+
+void bench_spilling_search() {
+    log("In-memory vs. disk-spilling existsBalancer:");
+
+    for (int splitters : {4, 5}) {
+        FlowStoreStats memory_stats;
+        auto start = Clock::now();
+        existsBalancer(3, 3, splitters, &memory_stats);
+        double memory_seconds = secondsSince(start);
+
+        FlowStoreStats spilled_stats;
+        SearchOptions spilled;
+        spilled.memory_limit = 1 << 20;
+        start = Clock::now();
+        existsBalancer(3, 3, splitters, &spilled_stats, spilled);
+        double spilled_seconds = secondsSince(start);
+
+        log(to_string(splitters) + " splitters, " + to_string(memory_stats.entries) + " flows: in memory " +
+            to_string(memory_seconds * 1e3) + " ms, " +
+            to_string((memory_stats.table_bytes + memory_stats.flow_bytes) >> 10) + " KiB; spilled " +
+            to_string(spilled_seconds * 1e3) + " ms, " + to_string(spilled.memory_limit >> 10) + " KiB limit, " +
+            to_string(spilled_stats.flow_bytes >> 10) + " KiB on disk");
+    }
+}
+
+void bench_checkpoint() {
+    log("Checkpoint cost per level of existsBalancer:");
+
+    SpillDirectory directory("");
+    SearchOptions options;
+    options.checkpoint_path = directory.path("search.checkpoint");
+    // Each level's time includes saving the level before it
+    double last_seconds = 0;
+    options.progress = [&](const SearchProgress& progress) {
+        log("level " + to_string(progress.level) + ": " + to_string(progress.visited) + " flows, " +
+            to_string((progress.seconds - last_seconds) * 1e3) + " ms");
+        last_seconds = progress.seconds;
+    };
+    auto start = Clock::now();
+    existsBalancer(3, 3, 5, nullptr, options);
+    double checkpointed_seconds = secondsSince(start);
+
+    start = Clock::now();
+    existsBalancer(3, 3, 5);
+    double plain_seconds = secondsSince(start);
+
+    start = Clock::now();
+    CheckpointInfo info = readCheckpointInfo(options.checkpoint_path);
+    SearchState<Matrix> state;
+    loadCheckpoint(options.checkpoint_path, state);
+    double load_seconds = secondsSince(start);
+
+    // Saves within a level only append the flows found since the last one
+    options.progress = nullptr;
+    options.checkpoint_seconds = 0.01;
+    start = Clock::now();
+    existsBalancer(3, 3, 5, nullptr, options);
+    double often_seconds = secondsSince(start);
+
+    log("5 splitters: " + to_string(plain_seconds * 1e3) + " ms plain, " + to_string(checkpointed_seconds * 1e3) +
+        " ms saving every level, " + to_string(often_seconds * 1e3) + " ms also every 10 ms; " +
+        to_string(info.flows) + " flows in " + to_string(info.flow_bytes >> 10) + " KiB, loaded in " +
+        to_string(load_seconds * 1e3) + " ms");
+}
+
+void bench_balancer_database() {
+    log("Balancer database queries vs. searching each time:");
+
+    SpillDirectory directory("");
+    string path = directory.path("balancers.db");
+    auto start = Clock::now();
+    {
+        BalancerDatabase database(path);
+        database.minSplitters(1, 1, 5);
+    }
+    double build_seconds = secondsSince(start);
+
+    start = Clock::now();
+    BalancerDatabase database(path);
+    double open_seconds = secondsSince(start);
+
+    const int queries = 100000;
+    int found = 0;
+    start = Clock::now();
+    for (int q = 0; q < queries; ++q) {
+        found += database.exists(1 + q % 6, 1 + q / 6 % 6, q % 6);
+    }
+    double query_seconds = secondsSince(start);
+
+    start = Clock::now();
+    existsBalancer(3, 3, 5);
+    double search_seconds = secondsSince(start);
+
+    log("Up to 5 splitters: built in " + to_string(build_seconds * 1e3) + " ms, opened in " +
+        to_string(open_seconds * 1e3) + " ms, " + to_string(query_seconds / queries * 1e9) + " ns/query (" +
+        to_string(found) + " found); existsBalancer(3, 3, 5) " + to_string(search_seconds * 1e3) + " ms");
+}
+
+void bench_balancer_sweep() {
+    log("One balancer sweep vs. a search per balancer, up to 4 -> 4 and 5 splitters:");
+
+    SearchOptions options;
+    options.prune = true;
+    auto start = Clock::now();
+    vector<vector<int>> swept = minBalancerSplitters(4, 5, options);
+    double sweep_seconds = secondsSince(start);
+
+    int found = 0;
+    for (const vector<int>& row : swept) {
+        for (int splitters : row) {
+            found += splitters != -1;
+        }
+    }
+
+    // Each balancer's fewest splitters, searching for one size at a time
+    int agreed = 0;
+    start = Clock::now();
+    for (int in = 1; in <= 4; ++in) {
+        for (int out = 1; out <= 4; ++out) {
+            int splitters = 0;
+            while (splitters <= 5 && !existsBalancer(in, out, splitters, nullptr, options)) {
+                ++splitters;
+            }
+            agreed += (splitters <= 5 ? splitters : -1) == swept[in - 1][out - 1];
+        }
+    }
+    double pair_seconds = secondsSince(start);
+
+    log("Sweep " + to_string(sweep_seconds * 1e3) + " ms (" + to_string(found) + " of 16 found), per balancer " +
+        to_string(pair_seconds * 1e3) + " ms (" + to_string(agreed) + " of 16 agree)");
+}
+
+void bench_find_balancer() {
+    log("findBalancer vs. existsBalancer, 4 -> 4 with up to 5 splitters, unpruned:");
+
+    FlowStoreStats stats;
+    auto start = Clock::now();
+    existsBalancer(4, 4, 5, &stats);
+    double exists_seconds = secondsSince(start);
+
+    OwnedNetwork balancer;
+    start = Clock::now();
+    bool found = findBalancer(4, 4, 5, &balancer);
+    double find_seconds = secondsSince(start);
+
+    size_t visited_bytes = stats.table_bytes + stats.flow_bytes;
+    size_t parent_bytes = stats.entries * sizeof(FlowParent);
+    log(to_string(stats.entries) + " flows: existsBalancer " + to_string(exists_seconds * 1e3) +
+        " ms, findBalancer " + to_string(find_seconds * 1e3) + " ms (" + (found ? to_string(balancer.size()) : "no") +
+        " nodes); parents " + to_string(parent_bytes / 1024) + " KiB vs. visited set " +
+        to_string(visited_bytes / 1024) + " KiB");
+}
+
+// Splitters of a Benes network fed by the given nodes, linked into links.
+// Returns the node each output comes out of, two per splitter of the last stage.
+vector<int> benesStages(const vector<int>& inputs, int& num_nodes, vector<pair<int, int>>& links) {
+    int n = inputs.size();
+    vector<int> upper, lower, outputs;
+    for (int j = 0; j < n / 2; ++j) {
+        int splitter = num_nodes++;
+        links.push_back({inputs[2 * j], splitter});
+        links.push_back({inputs[2 * j + 1], splitter});
+        upper.push_back(splitter);
+        lower.push_back(splitter);
+    }
+    if (n == 2) {
+        return {upper[0], upper[0]};
+    }
+    upper = benesStages(upper, num_nodes, links);
+    lower = benesStages(lower, num_nodes, links);
+    for (int j = 0; j < n / 2; ++j) {
+        int splitter = num_nodes++;
+        links.push_back({upper[j], splitter});
+        links.push_back({lower[j], splitter});
+        outputs.push_back(splitter);
+        outputs.push_back(splitter);
+    }
+    return outputs;
+}
+
+// An n -> n Benes network of splitters, for n a power of 2. It can route any
+// n inputs to any n outputs on separate belts, so it's throughput unlimited
+// and the check has to go through every pair of sets.
+OwnedNetwork benesNetwork(int n) {
+    vector<int> inputs(n);
+    for (int i = 0; i < n; ++i) {
+        inputs[i] = i;
+    }
+    int num_nodes = n;
+    vector<pair<int, int>> links;
+    vector<int> outputs = benesStages(inputs, num_nodes, links);
+    OwnedNetwork nodes(num_nodes + n);
+    for (const pair<int, int>& network_link : links) {
+        link(nodes, network_link.first, network_link.second);
+    }
+    for (int i = 0; i < n; ++i) {
+        link(nodes, outputs[i], num_nodes + i);
+    }
+    return nodes;
+}
+
+void bench_throughput() {
+    log("Throughput checks of Benes networks (unlimited, so every pair of sets is checked):");
+
+    // 16 -> 16 only up to sets of 4; all of it is 6e8 pairs
+    for (pair<int, int> check : {make_pair(4, 0), make_pair(8, 0), make_pair(16, 4)}) {
+        int n = check.first;
+        ThroughputOptions options;
+        options.max_set_size = check.second;
+        OwnedNetwork network = benesNetwork(n);
+        auto start = Clock::now();
+        bool unlimited = isThroughputUnlimited(network, nullptr, options);
+        double seconds = secondsSince(start);
+
+        // Pairs of equal-sized sets checked, out of every pair of sets
+        double pairs = 0;
+        double binomial = 1;
+        for (int k = 1; k <= (options.max_set_size > 0 ? options.max_set_size : n); ++k) {
+            binomial = binomial * (n - k + 1) / k;
+            pairs += binomial * binomial;
+        }
+        log(to_string(n) + " -> " + to_string(n) + ", " + to_string(network.size()) + " nodes: " +
+            (unlimited ? "unlimited" : "limited") + ", " + to_string((long)pairs) + " pairs of sets (of " +
+            to_string((long)ldexp(1.0, 2 * n)) + ") in " + to_string(seconds * 1e3) + " ms, " +
+            to_string(seconds / pairs * 1e9) + " ns/pair");
+    }
+}
+
+// Run f at least once and until it has taken min_seconds; returns seconds per call
+template <class F>
+double timePerCall(F f, double min_seconds = 0.05) {
+    long calls = 0;
+    auto start = Clock::now();
+    do {
+        f();
+        ++calls;
+    } while (secondsSince(start) < min_seconds);
+    return secondsSince(start) / calls;
+}
+
+string jsonString(const string& text) {
+    string quoted = "\"";
+    for (char c : text) {
+        if (c == '"' || c == '\\') {
+            quoted += '\\';
+        }
+        quoted += c;
+    }
+    return quoted + "\"";
+}
+
+// The whole suite as one JSON document, so runs can be kept and compared:
+// outputRatios on the test networks and on ladders of growing size,
+// addSplitterToFlow per call, and existsBalancer for every size up to
+// max_size -> max_size with up to max_num_splitters splitters
+void bench_json_suite(int max_size, int max_num_splitters) {
+    vector<string> ratios;
+    auto time_ratios = [&](const string& name, const Network& nodes) {
+        Matrix flow;
+        double seconds = timePerCall([&]() { flow = outputRatios(nodes); });
+        ratios.push_back("{\"network\": " + jsonString(name) + ", \"nodes\": " + to_string(nodes.size()) +
+                         ", \"ns_per_call\": " + to_string(seconds * 1e9) + "}");
+    };
+    for (TestNet (*make)() : {trivialLink, splitter1_2, splitter2_1, splitter2_2, balancer3_3, testnetA, testnetB}) {
+        TestNet net = make();
+        time_ratios(net.name, net.network);
+    }
+    for (int splitters : {125, 250, 500, 1000, 2000}) {
+        time_ratios("Ladder", ladderNetwork(splitters));
+    }
+
+    vector<Matrix> flows = reachableFlows(4);
+    vector<Configs> configs;
+    long calls = 0;
+    for (const Matrix& flow : flows) {
+        configs.push_back(validConfigs(flow));
+        calls += configs.back().size();
+    }
+    double attach_seconds = timePerCall([&]() {
+        for (int k = 0; k < flows.size(); ++k) {
+            for (const Config& config : configs[k]) {
+                addSplitterToFlow(flows[k], config[0], config[1]);
+            }
+        }
+    }) / calls;
+
+    vector<string> searches;
+    for (int in = 1; in <= max_size; ++in) {
+        for (int out = 1; out <= max_size; ++out) {
+            for (int splitters = 0; splitters <= max_num_splitters; ++splitters) {
+                FlowStoreStats stats;
+                auto start = Clock::now();
+                bool exists = existsBalancer(in, out, splitters, &stats);
+                double seconds = secondsSince(start);
+                searches.push_back("{\"input_size\": " + to_string(in) + ", \"output_size\": " + to_string(out) +
+                                   ", \"max_num_splitters\": " + to_string(splitters) + ", \"exists\": " +
+                                   (exists ? "true" : "false") + ", \"visited\": " + to_string(stats.entries) +
+                                   ", \"ms\": " + to_string(seconds * 1e3) + "}");
+            }
+        }
+    }
+
+    auto list = [](const vector<string>& items) {
+        string joined;
+        for (const string& item : items) {
+            joined += (joined.empty() ? "\n    " : ",\n    ") + item;
+        }
+        return "[" + joined + "\n  ]";
+    };
+    cout << "{\n  \"output_ratios\": " << list(ratios) << ",\n  \"add_splitter_to_flow\": {\"calls\": " << calls
+         << ", \"ns_per_call\": " << to_string(attach_seconds * 1e9) << "},\n  \"exists_balancer\": "
+         << list(searches) << "\n}\n";
+}
+
+void bench_random_corpus() {
+    log("Solvers on a corpus of random networks, streamed from disk:");
+
+    SpillDirectory directory("");
+    string path = directory.path("networks");
+    vector<RandomNetworkSpec> specs;
+    for (int nodes : {10, 100, 1000, 10000, 100000}) {
+        int ends = min(8, nodes / 5);
+        specs.push_back({nodes, ends, ends, (uint64_t)nodes});
+    }
+    auto start = Clock::now();
+    writeNetworkCorpus(path, specs);
+    log("Written in " + to_string(secondsSince(start) * 1e3) + " ms, " +
+        to_string(filesystem::file_size(path) / 1024) + " KiB");
+
+    NetworkCorpusReader corpus(path);
+    RandomNetworkSpec spec;
+    OwnedNetwork network;
+    while (corpus.next(spec, network)) {
+        Graph graph = toGraph(network);
+        double sparse_seconds = timePerCall([&]() { sourceRatios(graph); });
+        string line = to_string(spec.num_nodes) + " nodes: sourceRatios " + to_string(sparse_seconds * 1e3) + " ms";
+        // The dense solver's matrix is nodes x nodes
+        if (spec.num_nodes <= 1000) {
+            double dense_seconds = timePerCall([&]() { outputRatios(network); });
+            line += ", outputRatios " + to_string(dense_seconds * 1e3) + " ms";
+        }
+        log(line);
+    }
+}
+
+void bench_meet_in_the_middle() {
+    log("existsComposedBalancer, 8 -> 8, vs. existsBalancer over the same flows:");
+
+    FlowStoreStats stats;
+    auto start = Clock::now();
+    bool exists = existsBalancer(8, 8, 6, &stats);
+    log("existsBalancer with 6 splitters: " + to_string(stats.entries) + " flows, " + (exists ? "found" : "none") +
+        ", " + to_string(secondsSince(start)) + " s");
+
+    // Halves of up to 4, 5 and 6 splitters; the 3-stage butterfly needs 12
+    for (int splitters : {8, 10, 12}) {
+        Composition composition;
+        start = Clock::now();
+        bool found = existsComposedBalancer(8, 8, splitters, &composition);
+        string halves = found ? to_string(composition.first_splitters) + " + " +
+                                    to_string(composition.second_splitters) + " splitters"
+                              : "none";
+        log("existsComposedBalancer with " + to_string(splitters) + " splitters: " + halves + ", " +
+            to_string(secondsSince(start)) + " s");
+    }
+}
+
+// Returns whether there is a benchmark with this index
+bool run_benchmark_by_number(int benchmark_number) {
+    switch (benchmark_number) {
+        case 0:
+            bench_canonical_form();
+            return true;
+        case 1:
+            bench_output_ratios();
+            return true;
+        case 2:
+            bench_dynamic_flow();
+            return true;
+        case 3:
+            bench_flow_batch();
+            return true;
+        case 4:
+            bench_allocations();
+            return true;
+        case 5:
+            bench_owned_network();
+            return true;
+        case 6:
+            bench_spilling_search();
+            return true;
+        case 7:
+            bench_checkpoint();
+            return true;
+        case 8:
+            bench_balancer_database();
+            return true;
+        case 9:
+            bench_balancer_sweep();
+            return true;
+        case 10:
+            bench_find_balancer();
+            return true;
+        case 11:
+            bench_random_corpus();
+            return true;
+        case 12:
+            bench_throughput();
+            return true;
+        case 13:
+            bench_meet_in_the_middle();
+            return true;
+    }
+
+    return false;
+}
+
+int main(int argc, char **argv) {
+    if (argc == 1) {
+        int benchmark_to_run = 0;
+        while (run_benchmark_by_number(benchmark_to_run)) {
+            ++benchmark_to_run;
+        }
+    }
+    else if (std::string(argv[1]) == "json") {
+        // run_benchmarks json [max_size] [max_num_splitters]
+        bench_json_suite(argc > 2 ? std::stoi(argv[2]) : 4, argc > 3 ? std::stoi(argv[3]) : 4);
+    }
+    else if (argc >= 2) {
+        run_benchmark_by_number(std::stoi(std::string(argv[1])));
+    }
+}
@@ -1,10 +1,28 @@
 // Call the tests
 
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <filesystem>
 #include <iostream>
+#include <numeric>
 #include <string>
 
+#include "lib/balancer_database.hpp"
+#include "lib/canonical_form.hpp"
+#include "lib/checkpoint.hpp"
+#include "lib/dynamic_flow.hpp"
 #include "lib/exists_balancer.hpp"
+#include "lib/flow_batch.hpp"
+#include "lib/flow_runs.hpp"
+#include "lib/flow_store.hpp"
+#include "lib/graph.hpp"
+#include "lib/meet_in_the_middle.hpp"
+#include "lib/network_tools.hpp"
 #include "lib/output_ratios.hpp"
+#include "lib/random_network.hpp"
+#include "lib/thread_pool.hpp"
+#include "lib/throughput.hpp"
 #include "lib/utils.hpp"
 #include "tests/test_cases.hpp"
 #include "tests/test_utils.hpp"
@@ -19,6 +37,25 @@ void test_output_ratios() {
     test_outputRatio_first_column(balancer3_3());
     test_outputRatio_first_column(testnetA());  // 8 node test case
     test_outputRatio_first_column(testnetB());  // 17 node test case
+
+    test_outputRatio_exact(balancer3_3());
+    test_outputRatio_exact(testnetB());
+
+    // Nodes 0 and 1 feed a loop through 3, 4, 5 and 6; 2 joins it at 4
+    Graph graph = toGraph(balancer3_3().network);
+    Components components = stronglyConnectedComponents(graph);
+    bool loop_found = components.count() == 9;
+    for (int c = 0; c < components.count(); ++c) {
+        if (components.size(c) > 1) {
+            loop_found = loop_found && vector<int>(components.begin(c), components.begin(c) + 2) == vector<int>({4, 6});
+        }
+    }
+    vector<int> sources;
+    Matrix flow = sourceRatios(graph, &sources);
+    Matrix full_flow = outputRatios(balancer3_3().network);
+    bool sources_ok = sources == vector<int>({0, 1, 2}) && flow.cols() == 3 && flow[9][0] == full_flow[9][0] &&
+                      flow[9][2] == full_flow[9][2];
+    logTestResult("Components and sources", loop_found && sources_ok);
 }
 
 void test_balancer_exists() {
@@ -29,7 +66,8 @@ void test_balancer_exists() {
     //vector<vector<double>> new_network = addSplitter(my_network, {0}, {1, -1});
         
     // bool balancerExists = existsBalancer(5, 5, 6);
-    bool balancerExists = existsBalancer(4, 4, 4);
+    FlowStoreStats visited_stats;
+    bool balancerExists = existsBalancer(4, 4, 4, &visited_stats);
 
     if (balancerExists) {
         cout << "Balancer Exists!";
@@ -38,6 +76,871 @@ void test_balancer_exists() {
     }
     
     cout << "\n";
+    log(visited_stats);
+
+    FlowStoreStats exact_stats;
+    bool exactExists = existsBalancer<ExactMatrix>(4, 4, 4, &exact_stats);
+    logTestResult("Exact search agrees", exactExists == balancerExists);
+    log(exact_stats);
+
+    FlowStoreStats threaded_stats;
+    SearchOptions threaded;
+    threaded.threads = 4;
+    bool threadedExists = existsBalancer(4, 4, 4, &threaded_stats, threaded);
+    bool threaded_ok = threadedExists == balancerExists && threaded_stats.entries == visited_stats.entries &&
+                       threaded_stats.collisions == visited_stats.collisions;
+    logTestResult("Threaded search agrees", threaded_ok);
+
+    FlowStoreStats pruned_stats;
+    SearchOptions pruned;
+    pruned.prune = true;
+    bool prunedExists = existsBalancer(4, 4, 4, &pruned_stats, pruned);
+    bool pruned_ok = prunedExists == balancerExists && pruned_stats.entries < visited_stats.entries;
+    logTestResult("Pruned search agrees", pruned_ok && !existsBalancer(3, 3, 3, nullptr, pruned));
+
+    // Small enough that every level spills many runs
+    FlowStoreStats spilled_stats;
+    SearchOptions spilled;
+    spilled.memory_limit = 1 << 14;
+    spilled.threads = 2;
+    bool spilledExists = existsBalancer(4, 4, 4, &spilled_stats, spilled);
+    spilled.prune = true;
+    bool spilled_ok = spilledExists == balancerExists && spilled_stats.entries == visited_stats.entries &&
+                      existsBalancer(4, 4, 4, nullptr, spilled) == balancerExists;
+    logTestResult("Spilling search agrees", spilled_ok);
+
+    // The two outputs of a 1 -> 2 splitter are interchangeable, so only the
+    // first one is wired on its own
+    bool twin_skipped = true;
+    for (const Config& config : validConfigs(Matrix({{0.5}, {0.5}}))) {
+        twin_skipped = twin_skipped && config[0] != Wiring({1}) && config[0] != Wiring({-1, 1});
+    }
+    logTestResult("Skip twin wirings", twin_skipped);
+}
+
+void test_matrix() {
+    log("Running matrix checks:");
+
+    Matrix matrix = {{1, 2}, {3, 4}};
+    matrix.appendColumns(1);
+    Row extra_row = {5, 6, 7};
+    matrix.appendRow(extra_row.data());
+    Matrix expected = {{1, 2, 0}, {3, 4, 0}, {5, 6, 7}};
+    logTestResult("Append rows and columns", matrix == expected);
+
+    matrix.eraseRow(1);
+    matrix.eraseColumn(0);
+    expected = {{2, 0}, {6, 7}};
+    logTestResult("Erase rows and columns", matrix == expected);
+
+    // Grow past the inline storage and back
+    Matrix large(20, 20, 0.5);
+    large.appendColumns(3);
+    Matrix moved = move(large);
+    bool large_ok = moved.rows() == 20 && moved.cols() == 23 && moved[19][19] == 0.5 && moved[19][22] == 0;
+    logTestResult("Heap storage", large_ok && moved.heapBytes() > 0 && expected.heapBytes() == 0);
+
+    // Fewer but wider rows still have to make room for the old rows while moving them
+    Matrix tall(9, 7, 1);
+    tall.resize(6, 8);
+    bool tall_ok = tall.rows() == 6 && tall.cols() == 8 && tall[5][6] == 1 && tall[5][7] == 0;
+    logTestResult("Fewer, wider rows", tall_ok);
+
+    // Rows wider apart than their length have to be packed before transposing
+    Matrix wide(3, 7);
+    wide.eraseColumn(6);
+    wide.eraseColumn(5);
+    for (int i = 0; i < 3; ++i) {
+        for (int j = 0; j < 5; ++j) {
+            wide[i][j] = 10 * i + j;
+        }
+    }
+    Matrix wide_t = wide;
+    wide_t.transposeInPlace();
+    bool transposed = wide_t.rows() == 5 && wide_t.cols() == 3;
+    for (int i = 0; i < 3; ++i) {
+        for (int j = 0; j < 5; ++j) {
+            transposed = transposed && wide_t[j][i] == wide[i][j];
+        }
+    }
+    wide_t.transposeInPlace();
+    logTestResult("Transpose in place", transposed && wide_t == wide);
+
+    // A fixed stride keeps rows in place as columns come and go
+    BasicMatrix<double, 25, 5> fixed = {{1, 2}, {3, 4}, {5, 6}};
+    fixed.appendColumns(2);
+    fixed[2][3] = 7;
+    fixed.transposeInPlace();
+    bool fixed_ok = fixed.stride() == 5 && fixed.rows() == 4 && fixed.cols() == 3 && fixed[1][2] == 6 &&
+                    fixed[3][2] == 7 && fixed[3][0] == 0;
+    bool too_wide = false;
+    try {
+        fixed.appendColumns(3);
+    } catch (const char*) {
+        too_wide = true;
+    }
+    logTestResult("Fixed stride", fixed_ok && too_wide);
+
+    Matrix a = {{0, 1}}, b = {{0, 1}, {0, 0}}, c = {{1}};
+    logTestResult("Lexicographic order", a < b && b < c && !(c < a) && transpose(b) == Matrix({{0, 0}, {1, 0}}));
+}
+
+void test_canonical_form() {
+    log("Running canonical form checks:");
+
+    // The same flow with its rows and columns permuted
+    Matrix flow = {{0.5, 0.25, 0}, {0.5, 0.25, 0}, {0, 0.5, 1}};
+    Matrix permuted = {{1, 0.5, 0}, {0, 0.25, 0.5}, {0, 0.25, 0.5}};
+    logTestResult("Permutations agree", canonicalForm(flow) == canonicalForm(permuted));
+
+    // Sorting rows and columns alone leaves these two apart
+    Matrix tied = {{0, 0, 1, 0}, {0, 0, 1, 0}, {0, 0, 1, 1}, {1, 1, 1, 0}};
+    Matrix relabeled = {{0, 0, 1, 0}, {0, 1, 1, 1}, {1, 0, 1, 0}, {0, 0, 1, 0}};
+    logTestResult("Tied rows and columns", canonicalForm(tied) == canonicalForm(relabeled));
+
+    Matrix other = {{0.5, 0.25, 0}, {0.5, 0.5, 0}, {0, 0.25, 1}};
+    logTestResult("Different flows differ", canonicalForm(flow) != canonicalForm(other));
+
+    vector<int> row_order, col_order;
+    Matrix form = canonicalForm(permuted, &row_order, &col_order);
+    bool orders_ok = true;
+    for (int i = 0; i < form.rows(); ++i) {
+        for (int j = 0; j < form.cols(); ++j) {
+            orders_ok = orders_ok && form[i][j] == permuted[row_order[i]][col_order[j]];
+        }
+    }
+    logTestResult("Row and column orders", orders_ok);
+}
+
+void test_flow_store() {
+    log("Running flow store checks:");
+
+    FlowStore store;
+    bool inserted = store.insert({{1}});
+    inserted = store.insert({{0.5, 0.5}, {0.5, 0.5}}) && inserted;
+    inserted = store.insert({{1, 0}, {0, 1}}) && inserted;
+    logTestResult("Insert new flows", inserted && store.size() == 3);
+
+    bool duplicate = store.insert({{0.5, 0.5}, {0.5, 0.5}}) || store.insert({{1, -0.0}, {0, 1}});
+    logTestResult("Reject duplicates", !duplicate && store.size() == 3);
+
+    bool found = store.find({{1, 0}, {0, 1}}) == 2 && !store.contains({{0.5}, {0.5}});
+    logTestResult("Find flows", found);
+
+    // Force a few rehashes
+    for (int i = 0; i < 1000; ++i) {
+        store.insert({{1.0 / (i + 2), 1 - 1.0 / (i + 2)}});
+    }
+    bool kept = store.size() == 1003 && store.contains({{1.0 / 500, 1 - 1.0 / 500}}) && store.contains({{1}});
+    logTestResult("Keep flows when growing", kept && store.stats().load_factor <= 0.5);
+}
+
+void test_thread_pool() {
+    log("Running thread pool checks:");
+
+    ThreadPool pool(4);
+    vector<int> counts(1000);
+    vector<int> sums(pool.threads());
+    pool.parallelFor(counts.size(), [&](int thread, int i) {
+        ++counts[i];
+        sums[thread] += i;
+    });
+    bool once = count(counts.begin(), counts.end(), 1) == counts.size();
+    logTestResult("Run every index once", once && accumulate(sums.begin(), sums.end(), 0) == 999 * 1000 / 2);
+
+    bool rethrown = false;
+    try {
+        pool.parallelFor(100, [&](int, int i) {
+            if (i == 57) {
+                throw "Failed";
+            }
+        });
+    } catch (const char*) {
+        rethrown = true;
+    }
+    logTestResult("Rethrow exceptions", rethrown);
+}
+
+void test_dynamic_flow() {
+    log("Running dynamic flow checks:");
+
+    // Each one edits its own copy of the network's nodes
+    TestNet exact_net = testnetB();
+    TestNet approximate_net = testnetB();
+    DynamicFlow<ExactMatrix> exact(exact_net.network);
+    DynamicFlow<Matrix> approximate(approximate_net.network);
+    bool initial_ok = exact.flow() == outputRatios<ExactMatrix>(exact.network());
+
+    // Edits that open and close loops, turn an input node into an inner node
+    // and back, and add a self-loop
+    vector<pair<int, int>> removed = {{10, 12}, {0, 1}, {6, 8}};
+    vector<pair<int, int>> added = {{13, 2}, {0, 1}, {15, 7}, {12, 12}, {12, 0}};
+    bool edits_ok = true;
+    double worst_error = 0;
+    auto check = [&]() {
+        ExactMatrix expected = outputRatios<ExactMatrix>(exact.network());
+        edits_ok = edits_ok && exact.flow() == expected;
+        Matrix flow = approximate.flow();
+        for (int i = 0; i < flow.rows(); ++i) {
+            for (int j = 0; j < flow.cols(); ++j) {
+                worst_error = max(worst_error, fabs(flow[i][j] - expected[i][j].toDouble()));
+            }
+        }
+    };
+    for (auto& edit : removed) {
+        exact.removeLink(edit.first, edit.second);
+        approximate.removeLink(edit.first, edit.second);
+        check();
+    }
+    for (auto& edit : added) {
+        exact.addLink(edit.first, edit.second);
+        approximate.addLink(edit.first, edit.second);
+        check();
+    }
+    logTestResult("Initial flow", initial_ok);
+    logTestResult("Flow after link edits", edits_ok && worst_error < 1e-12);
+
+    // Node 1 -> 2 -> 1 with no way out can't be solved, and the edit is undone
+    TestNet splitter = splitter1_2();
+    DynamicFlow<ExactMatrix> looped(splitter.network);
+    bool rejected = false;
+    try {
+        looped.removeLink(1, 3);
+        looped.addLink(2, 1);
+    } catch (const char*) {
+        rejected = true;
+    }
+    bool undone = looped.network()[2]->outputs.empty() && looped.flow() == outputRatios<ExactMatrix>(looped.network());
+    logTestResult("Reject closed loops", rejected && undone);
+
+    // Removing a loop's way out throws once the source's row has already been
+    // updated for its one fewer output, and that has to be undone too. With
+    // doubles, the loop's pivot is only zero up to rounding, and has to be
+    // rejected all the same.
+    int thrown = 0;
+    bool kept = true;
+    bool approximate_agrees = true;
+    for (uint64_t seed = 0; seed < 40; ++seed) {
+        OwnedNetwork random = randomNetwork({12, 2, 2, seed, 0.5});
+        OwnedNetwork approximate_random = randomNetwork({12, 2, 2, seed, 0.5});
+        const Network& nodes = random;
+        DynamicFlow<ExactMatrix> edited(random);
+        DynamicFlow<Matrix> approximate_edited(approximate_random);
+        for (int source = 0; source < nodes.size(); ++source) {
+            if (nodes[source]->inputs.empty() || nodes[source]->outputs.size() < 2) {
+                continue;
+            }
+            vector<Node*> targets(nodes[source]->outputs.begin(), nodes[source]->outputs.end());
+            for (Node* target_node : targets) {
+                int target = find(nodes.begin(), nodes.end(), target_node) - nodes.begin();
+                ExactMatrix before = edited.flow();
+                bool exact_threw = false;
+                try {
+                    edited.removeLink(source, target);
+                    edited.addLink(source, target);
+                } catch (const char*) {
+                    ++thrown;
+                    exact_threw = true;
+                    kept = kept && edited.flow() == before;
+                }
+                bool approximate_threw = false;
+                try {
+                    approximate_edited.removeLink(source, target);
+                    approximate_edited.addLink(source, target);
+                } catch (const char*) {
+                    approximate_threw = true;
+                }
+                approximate_agrees = approximate_agrees && approximate_threw == exact_threw;
+            }
+        }
+    }
+    logTestResult("Failed removals leave the flow", thrown > 0 && kept);
+    logTestResult("Reject closed loops with doubles", approximate_agrees);
+}
+
+void test_flow_batch() {
+    log("Running flow batch checks:");
+
+    // Three 2 -> 2 flows of the same shape, with 11 lanes so the padding is used
+    vector<Matrix> flows = {{{0.5, 0.5}, {0.5, 0.5}}, {{0.75, 0.25}, {0.25, 0.75}}, {{1, 0}, {0.2, 0.8}}};
+    FlowBatch<double> batch(2, 2, 11);
+    for (int lane = 0; lane < batch.lanes(); ++lane) {
+        batch.store(lane, flows[lane % flows.size()]);
+    }
+
+    bool matches = true;
+    for (const Config& config : validConfigs(flows[0])) {
+        FlowBatch<double> result = attachSplitterBatch(batch, config[0], config[1]);
+        for (int lane = 0; lane < batch.lanes(); ++lane) {
+            matches = matches && result.load(lane) == attachSplitter(flows[lane % flows.size()], config[0], config[1]);
+        }
+    }
+    logTestResult("Batch matches scalar", matches);
+
+    ExactMatrix exact_flow = {{Rational(2, 3), Rational(1, 3)}, {Rational(1, 3), Rational(2, 3)}};
+    FlowBatch<Rational> exact_batch(2, 2, 1);
+    exact_batch.store(0, exact_flow);
+    FlowBatch<Rational> exact_result = attachSplitterBatch(exact_batch, {0, -1}, {1, -1});
+    logTestResult("Exact batch", exact_result.load(0) == attachSplitter(exact_flow, {0, -1}, {1, -1}));
+
+    // Both splitter outputs wired back is not supported, for either type
+    bool rejected = true;
+    try {
+        attachSplitterBatch(batch, {0, -1}, {0, 1});
+        rejected = false;
+    } catch (const char*) {
+    }
+    try {
+        attachSplitterBatch(exact_batch, {0, 1}, {0, 1});
+        rejected = false;
+    } catch (const char*) {
+    }
+    logTestResult("Reject two wired outputs", rejected);
+}
+
+void test_owned_network() {
+    log("Running owned network checks:");
+
+    // The same links as splitter1_2(), on nodes from the heap one by one
+    Network loose = emptyNetwork(4);
+    link(loose, 0, 1);
+    link(loose, 1, 2);
+    link(loose, 1, 3);
+
+    TestNet splitter = splitter1_2();
+    bool contiguous = true;
+    for (int i = 0; i < splitter.network.size(); ++i) {
+        contiguous = contiguous && splitter.network[i] == splitter.network[0] + i;
+    }
+    logTestResult("Nodes in index order", contiguous);
+
+    // Moving keeps the nodes and links where they are
+    Node* first = splitter.network[0];
+    OwnedNetwork moved = move(splitter.network);
+    bool moved_ok = moved[0] == first && moved[1]->outputs.size() == 2 && moved[2]->inputs[0] == moved[1];
+    logTestResult("Move keeps nodes", moved_ok && outputRatios(moved) == outputRatios(loose));
+
+    unlink(moved, 1, 3);
+    link(moved, 1, 3);
+    logTestResult("Edit links", moved[1]->outputs.size() == 2 && outputRatios(moved) == outputRatios(loose));
+    for (Node* node : loose) {
+        delete node;
+    }
+}
+
+void test_flow_runs() {
+    log("Running flow run checks:");
+
+    Matrix flow = {{0.5, -0.0}, {0.25, 0.75}};
+    ExactMatrix exact_flow = {{Rational(1, 3), Rational(2, 3)}};
+    string bytes, zero_bytes, exact_bytes;
+    encodeFlow(flow, bytes);
+    encodeFlow(Matrix({{0.5, 0}, {0.25, 0.75}}), zero_bytes);
+    encodeFlow(exact_flow, exact_bytes);
+    bool round_trip = decodeFlow<Matrix>(bytes) == flow && decodeFlow<ExactMatrix>(exact_bytes) == exact_flow;
+    logTestResult("Encode and decode", round_trip && bytes == zero_bytes);
+
+    // Many tiny runs with repeats, merged down in more than one pass
+    SpillDirectory directory("");
+    RunBuffer buffer(directory.path("run-"), 64);
+    for (int i = 0; i < 5000; ++i) {
+        buffer.add(to_string(i * 7919 % 1000));
+    }
+    vector<string> runs = buffer.finish();
+    RunMerger merger(runs);
+    vector<string> merged;
+    string record;
+    while (merger.next(record)) {
+        merged.push_back(record);
+    }
+    bool sorted_unique = merged.size() == 1000 && adjacent_find(merged.begin(), merged.end(), [](auto& a, auto& b) {
+                             return !(a < b);
+                         }) == merged.end();
+    logTestResult("Merge sorted runs", runs.size() <= 64 && sorted_unique);
+}
+
+void test_checkpoint() {
+    log("Running checkpoint checks:");
+
+    FlowStoreStats full_stats;
+    bool full = existsBalancer(4, 4, 4, &full_stats);
+
+    SpillDirectory directory("");
+    SearchOptions options;
+    options.checkpoint_path = directory.path("search.checkpoint");
+    vector<int> levels;
+    options.progress = [&](const SearchProgress& progress) {
+        levels.push_back(progress.level);
+    };
+    existsBalancer(4, 4, 4, nullptr, options);
+    CheckpointInfo info = readCheckpointInfo(options.checkpoint_path);
+    bool saved = info.level == 4 && info.flows == full_stats.entries && info.input_size == 4 &&
+                 levels == vector<int>({1, 2, 3, 4});
+    logTestResult("Save every level", saved);
+
+    // The checkpoint's flows files; a new generation replaces the old one
+    auto flowsFiles = [&]() {
+        vector<string> paths;
+        filesystem::path checkpoint_path(options.checkpoint_path);
+        for (const auto& entry : filesystem::directory_iterator(checkpoint_path.parent_path())) {
+            if (entry.path().filename().string().rfind(checkpoint_path.filename().string() + ".flows-", 0) == 0) {
+                paths.push_back(entry.path().string());
+            }
+        }
+        return paths;
+    };
+
+    // Every save after the first appended to the same flows file
+    vector<string> flows_files = flowsFiles();
+    logTestResult("Append each level's flows", flows_files == vector<string>({options.checkpoint_path + ".flows-1"}) &&
+                                                   filesystem::file_size(flows_files[0]) == info.flow_bytes);
+
+    // Kill the search part way through a level, after saving between batches
+    for (int stop_level : {2, 3}) {
+        options.checkpoint_seconds = 1e-9;
+        options.progress = [&](const SearchProgress& progress) {
+            if (progress.level == stop_level) {
+                throw "Killed";
+            }
+        };
+        bool killed = false;
+        try {
+            existsBalancer(4, 4, 4, nullptr, options);
+        } catch (const char*) {
+            killed = true;
+        }
+
+        // As if a later save was killed while appending to the flows file
+        flows_files = flowsFiles();
+        killed = killed && flows_files.size() == 1;
+        FILE* flows_file = fopen(flows_files[0].c_str(), "ab");
+        fputs("partial", flows_file);
+        fclose(flows_file);
+
+        FlowStoreStats resumed_stats;
+        SearchOptions resumed;
+        resumed.threads = 2;
+        bool resumed_ok = killed && readCheckpointInfo(options.checkpoint_path).level == stop_level - 1 &&
+                          resumeBalancer(options.checkpoint_path, &resumed_stats, resumed) == full &&
+                          resumed_stats.entries == full_stats.entries;
+        logTestResult("Resume from level " + to_string(stop_level - 1), resumed_ok);
+    }
+
+    bool rejected = false;
+    try {
+        resumeBalancer<ExactMatrix>(options.checkpoint_path);
+    } catch (const char*) {
+        rejected = true;
+    }
+    logTestResult("Check value type", rejected);
+
+    // Pruning changes the flows visited, so a pruned search only resumes pruned
+    options.prune = true;
+    options.progress = [&](const SearchProgress& progress) {
+        if (progress.level == 2) {
+            throw "Killed";
+        }
+    };
+    try {
+        existsBalancer(4, 4, 4, nullptr, options);
+    } catch (const char*) {
+    }
+    bool prune_rejected = false;
+    try {
+        resumeBalancer(options.checkpoint_path);
+    } catch (const char*) {
+        prune_rejected = true;
+    }
+    SearchOptions pruned;
+    pruned.prune = true;
+    logTestResult("Check prune option", prune_rejected && readCheckpointInfo(options.checkpoint_path).prune &&
+                                            resumeBalancer(options.checkpoint_path, nullptr, pruned) == full);
+}
+
+void test_balancer_database() {
+    log("Running balancer database checks:");
+
+    SpillDirectory directory("");
+    string path = directory.path("balancers.db");
+    bool agrees = true;
+    {
+        BalancerDatabase database(path);
+        for (int in = 1; in <= 4; ++in) {
+            for (int out = 1; out <= 4; ++out) {
+                agrees = agrees && database.exists(in, out, 3) == existsBalancer(in, out, 3);
+            }
+        }
+        agrees = agrees && database.splitters() == 3 && database.minSplitters(1, 1, 0) == 0;
+    }
+    logTestResult("Agrees with search", agrees);
+
+    // Reopened, queries up to 3 splitters are lookups, and 4 carries on the search
+    BalancerDatabase reopened(path);
+    bool looked_up = reopened.splitters() == 3 && reopened.minSplitters(2, 2, 3) == 1;
+    FlowStoreStats stats;
+    bool exists = existsBalancer(4, 4, 4, &stats);
+    bool extended = reopened.exists(4, 4, 4) == exists && reopened.splitters() == 4 &&
+                    reopened.flowCount(4) == stats.entries && reopened.flowCount(0) == 1;
+    logTestResult("Reopen and extend", looked_up && extended);
+
+    // Progress calls within a level don't count as levels
+    SearchOptions often;
+    often.progress_seconds = 1e-9;
+    often.progress = [](const SearchProgress&) {};
+    BalancerDatabase logged(directory.path("logged.db"), often);
+    bool same_levels = logged.minSplitters(4, 4, 5) == 4 && logged.splitters() == 5 &&
+                       logged.flowCount(4) == stats.entries;
+    logTestResult("Progress within levels", same_levels);
+}
+
+void test_balancer_sweep() {
+    log("Running balancer sweep checks:");
+
+    SpillDirectory directory("");
+    BalancerDatabase database(directory.path("balancers.db"));
+    vector<vector<int>> swept = minBalancerSplitters(4, 4);
+    SearchOptions options;
+    options.prune = true;
+    options.threads = 4;
+    vector<vector<int>> pruned = minBalancerSplitters(4, 4, options);
+    vector<vector<int>> exact = minBalancerSplitters<ExactMatrix>(4, 4);
+
+    bool agrees = swept.size() == 4;
+    for (int in = 1; agrees && in <= 4; ++in) {
+        for (int out = 1; out <= 4; ++out) {
+            agrees = agrees && swept[in - 1][out - 1] == database.minSplitters(in, out, 4);
+        }
+    }
+    logTestResult("Agrees with database", agrees);
+    logTestResult("Pruned and exact sweeps agree", pruned == swept && exact == swept);
+}
+
+// Whether a network's last output_size nodes each get an even share of each of
+// the input_size nodes before them
+bool balancesEvenly(const Network& network, int input_size, int output_size) {
+    ExactMatrix ratios = outputRatios<ExactMatrix>(network);
+    int first_input = network.size() - output_size - input_size;
+    bool even = true;
+    for (int i = network.size() - output_size; i < network.size(); ++i) {
+        for (int j = first_input; j < first_input + input_size; ++j) {
+            even = even && ratios[i][j] == Rational(1, output_size);
+        }
+    }
+    return even;
+}
+
+void test_find_balancer() {
+    log("Running balancer witness checks:");
+
+    // Every size up to 4 -> 4 that 4 splitters can do, with and without pruning
+    bool balances = true;
+    bool agrees = true;
+    SearchOptions pruned;
+    pruned.prune = true;
+    pruned.threads = 3;
+    for (int in = 1; in <= 4; ++in) {
+        for (int out = 1; out <= 4; ++out) {
+            for (const SearchOptions& options : {SearchOptions(), pruned}) {
+                OwnedNetwork network;
+                bool found = findBalancer(in, out, 4, &network, nullptr, options);
+                agrees = agrees && found == existsBalancer(in, out, 4);
+                balances = balances && (!found || balancesEvenly(network, in, out));
+            }
+        }
+    }
+    logTestResult("Agrees with existsBalancer", agrees);
+    logTestResult("Witnesses balance", balances);
+
+    OwnedNetwork exact;
+    bool exact_found = findBalancer<ExactMatrix>(3, 3, 4, &exact, nullptr, pruned);
+    logTestResult("Exact witness", exact_found && balancesEvenly(exact, 3, 3));
+}
+
+void test_search_stats() {
+    log("Running search stats checks:");
+
+    SearchStats stats;
+    size_t progress_calls = 0;
+    size_t partial_levels = 0;
+    SearchOptions options;
+    options.threads = 3;
+    options.stats = &stats;
+    options.progress_seconds = 1e-9;
+    options.progress = [&](const SearchProgress& progress) {
+        ++progress_calls;
+        partial_levels += progress.frontier_done > 0;
+    };
+    FlowStoreStats visited;
+    existsBalancer(3, 3, 4, &visited, options);
+
+    LevelStats total = stats.total();
+    bool levels_ok = stats.levels.size() == 4 && stats.levels[0].level == 1 && stats.levels[0].expanded == 1 &&
+                     total.level == 4 && total.new_flows + 1 == visited.entries;
+    logTestResult("Level counts", levels_ok);
+    logTestResult("Progress within levels", progress_calls > 4 && partial_levels > 0);
+
+    // The search with its flows on disk expands and finds the same per level
+    SearchStats spilled_stats;
+    SearchOptions spilled;
+    spilled.stats = &spilled_stats;
+    spilled.memory_limit = 1 << 14;
+    existsBalancer(3, 3, 4, nullptr, spilled);
+    bool spilled_ok = spilled_stats.levels.size() == stats.levels.size();
+    for (int i = 0; i < stats.levels.size() && spilled_ok; ++i) {
+        const LevelStats& level = stats.levels[i];
+        const LevelStats& spilled_level = spilled_stats.levels[i];
+        spilled_ok = spilled_level.level == level.level && spilled_level.expanded == level.expanded &&
+                     spilled_level.new_flows == level.new_flows && spilled_level.configs == level.configs &&
+                     spilled_level.duplicates == level.duplicates;
+    }
+    logTestResult("Spilled level counts", spilled_ok);
+
+    // Every config tried either made a new flow or one already found
+    bool counters_ok = true;
+    if (search_stats_enabled) {
+        counters_ok = total.configs == total.new_flows + total.duplicates && total.counters.circular > 0 &&
+                      total.counters.labelings >= total.configs;
+    }
+    logTestResult(search_stats_enabled ? "Counters add up" : "Counters compiled out",
+                  counters_ok && (search_stats_enabled || total.configs == 0));
+}
+
+void test_random_network() {
+    log("Running random network checks:");
+
+    // Splitters have one or two of each, input nodes no inputs and output nodes no outputs
+    RandomNetworkSpec spec = {1000, 7, 12, 42};
+    OwnedNetwork network = randomNetwork(spec);
+    bool shape_ok = true;
+    for (int i = 0; i < network.size(); ++i) {
+        int ins = network[i]->inputs.size();
+        int outs = network[i]->outputs.size();
+        if (i < spec.num_inputs) {
+            shape_ok = shape_ok && ins == 0 && outs == 1;
+        } else if (i >= spec.num_nodes - spec.num_outputs) {
+            shape_ok = shape_ok && ins == 1 && outs == 0;
+        } else {
+            shape_ok = shape_ok && ins >= 1 && ins <= 2 && outs >= 1 && outs <= 2;
+        }
+    }
+    RandomNetworkSpec other_seed = spec;
+    other_seed.seed = 43;
+    bool seeded = randomLinks(spec) == randomLinks(spec) && randomLinks(spec) != randomLinks(other_seed);
+    logTestResult("Shape and seeding", shape_ok && seeded);
+
+    // Stream a corpus back and check the dense and sparse solvers against each
+    // other, and that every input's flow all comes out
+    SpillDirectory directory("");
+    string path = directory.path("networks");
+    vector<RandomNetworkSpec> specs;
+    for (int nodes : {10, 30, 100, 300, 1000}) {
+        specs.push_back({nodes, 1 + nodes / 40, 1 + nodes / 25, (uint64_t)nodes, 0.3});
+    }
+    writeNetworkCorpus(path, specs);
+
+    NetworkCorpusReader corpus(path);
+    RandomNetworkSpec read_spec;
+    OwnedNetwork read_network;
+    int networks = 0;
+    bool specs_ok = corpus.size() == specs.size();
+    double worst_error = 0;
+    while (corpus.next(read_spec, read_network)) {
+        const RandomNetworkSpec& expected = specs[networks++];
+        specs_ok = specs_ok && read_spec.num_nodes == expected.num_nodes && read_spec.seed == expected.seed &&
+                   read_network.size() == expected.num_nodes;
+
+        Matrix dense = outputRatios(read_network);
+        vector<int> sources;
+        Matrix sparse = sourceRatios(toGraph(read_network), &sources);
+        int first_output = read_spec.num_nodes - read_spec.num_outputs;
+        for (int k = 0; k < sources.size(); ++k) {
+            double total = 0;
+            for (int i = 0; i < read_spec.num_nodes; ++i) {
+                worst_error = max(worst_error, fabs(dense[i][sources[k]] - sparse[i][k]));
+                total += i >= first_output ? sparse[i][k] : 0;
+            }
+            worst_error = max(worst_error, fabs(total - 1));
+        }
+    }
+    logTestResult("Corpus round trip", specs_ok && networks == specs.size());
+    logTestResult("Solvers agree", worst_error < 1e-9);
+}
+
+// Max flow from some nodes to others with a belt of capacity 1 per link, solved
+// from scratch on a dense capacity matrix
+int bruteForceMaxFlow(const Graph& graph, const vector<int>& from, const vector<int>& to) {
+    int size = graph.size + 2;
+    int source = graph.size, sink = graph.size + 1;
+    vector<vector<int>> capacity(size, vector<int>(size, 0));
+    for (int node = 0; node < graph.size; ++node) {
+        for (int e = graph.output_start[node]; e < graph.output_start[node + 1]; ++e) {
+            ++capacity[node][graph.outputs[e]];
+        }
+    }
+    for (int node : from) {
+        capacity[source][node] = 1;
+    }
+    for (int node : to) {
+        capacity[node][sink] = 1;
+    }
+    int flow = 0;
+    while (true) {
+        vector<int> parent(size, -1);
+        vector<int> queue = {source};
+        parent[source] = source;
+        for (int head = 0; head < queue.size() && parent[sink] == -1; ++head) {
+            for (int next = 0; next < size; ++next) {
+                if (parent[next] == -1 && capacity[queue[head]][next] > 0) {
+                    parent[next] = queue[head];
+                    queue.push_back(next);
+                }
+            }
+        }
+        if (parent[sink] == -1) {
+            return flow;
+        }
+        for (int at = sink; at != source; at = parent[at]) {
+            --capacity[parent[at]][at];
+            ++capacity[at][parent[at]];
+        }
+        ++flow;
+    }
+}
+
+// Throughput unlimited by trying every pair of input and output sets
+bool bruteForceUnlimited(const Graph& graph) {
+    vector<int> inputs, outputs;
+    for (int node = 0; node < graph.size; ++node) {
+        if (graph.inputCount(node) == 0) {
+            inputs.push_back(node);
+        }
+        if (graph.outputCount(node) == 0) {
+            outputs.push_back(node);
+        }
+    }
+    for (int a = 1; a < (1 << inputs.size()); ++a) {
+        for (int b = 1; b < (1 << outputs.size()); ++b) {
+            vector<int> from, to;
+            for (int k = 0; k < inputs.size(); ++k) {
+                if (a >> k & 1) {
+                    from.push_back(inputs[k]);
+                }
+            }
+            for (int k = 0; k < outputs.size(); ++k) {
+                if (b >> k & 1) {
+                    to.push_back(outputs[k]);
+                }
+            }
+            if (bruteForceMaxFlow(graph, from, to) < min(from.size(), to.size())) {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+// A 4 -> 4 balancer of two rows of two splitters, and with layers more
+// splitters after them
+OwnedNetwork layeredBalancer4_4(int layers) {
+    // Inputs 0-3, then two splitters per layer, then outputs
+    int splitters = 2 * layers;
+    OwnedNetwork nodes(8 + splitters);
+    link(nodes, 0, 4);
+    link(nodes, 1, 4);
+    link(nodes, 2, 5);
+    link(nodes, 3, 5);
+    for (int layer = 1; layer < layers; ++layer) {
+        int a = 4 + 2 * (layer - 1), b = a + 1;
+        link(nodes, a, b + 1);
+        link(nodes, a, b + 2);
+        link(nodes, b, b + 1);
+        link(nodes, b, b + 2);
+    }
+    int last = 4 + splitters - 2;
+    int first_output = 4 + splitters;
+    link(nodes, last, first_output);
+    link(nodes, last, first_output + 1);
+    link(nodes, last + 1, first_output + 2);
+    link(nodes, last + 1, first_output + 3);
+    return nodes;
+}
+
+void test_throughput() {
+    log("Running throughput checks:");
+
+    ThroughputLimit limit;
+    bool two_layers = isThroughputUnlimited(layeredBalancer4_4(2), &limit);
+    bool limit_ok = !two_layers && limit.inputs.size() == limit.outputs.size() && limit.max_flow < limit.inputs.size();
+    bool three_layers = isThroughputUnlimited(layeredBalancer4_4(3));
+    logTestResult("4 -> 4 balancers", limit_ok && three_layers && isThroughputUnlimited(splitter2_2().network));
+
+    // The incremental flow against solving every pair of sets from scratch
+    int agree = 0, unlimited = 0;
+    const int networks = 60;
+    for (int n = 0; n < networks; ++n) {
+        RandomNetworkSpec spec = {14 + n % 10, 2 + n % 3, 2 + n / 3 % 3, (uint64_t)n, 0.3};
+        Graph graph = toGraph(randomNetwork(spec));
+        ThroughputOptions options;
+        options.threads = 1 + n % 3;
+        bool fast = isThroughputUnlimited(graph, nullptr, options);
+        agree += fast == bruteForceUnlimited(graph);
+        unlimited += fast;
+    }
+    logTestResult("Agrees with brute force", agree == networks && unlimited > 0 && unlimited < networks);
+}
+
+void test_meet_in_the_middle() {
+    log("Running meet-in-the-middle checks:");
+
+    auto balances = [](const Matrix& flow, int in, int out) {
+        bool even = flow.rows() == out && flow.cols() == in;
+        for (int i = 0; i < flow.rows() && even; ++i) {
+            for (int j = 0; j < flow.cols(); ++j) {
+                even = even && fabs(flow[i][j] - 1.0 / out) < 1e-9;
+            }
+        }
+        return even;
+    };
+
+    // Whatever it finds is there, and its halves make a balancer
+    bool sound = true;
+    bool composes = true;
+    SearchOptions options;
+    options.threads = 3;
+    for (int in = 1; in <= 4; ++in) {
+        for (int out = 1; out <= 4; ++out) {
+            for (int splitters = 0; splitters <= 5; ++splitters) {
+                Composition composition;
+                if (existsComposedBalancer(in, out, splitters, &composition, options)) {
+                    sound = sound && existsBalancer(in, out, splitters);
+                    composes = composes && balances(composedFlow(composition), in, out) &&
+                               composition.first_splitters + composition.second_splitters <= splitters;
+                }
+            }
+        }
+    }
+    logTestResult("Only finds balancers that exist", sound);
+    logTestResult("Halves compose to a balancer", composes);
+
+    // Two splitters side by side, then two more each taking an output of both
+    Composition four;
+    logTestResult("Finds 4 -> 4 from two halves",
+                  existsComposedBalancer(4, 4, 4, &four) && four.first_splitters == 2 && four.second_splitters == 2);
+    logTestResult("Not 4 -> 4 from 3", !existsComposedBalancer(4, 4, 3));
+
+    // Threads only change how fast it finds the same halves
+    Composition threaded;
+    bool same = true;
+    for (int threads : {2, 4}) {
+        options.threads = threads;
+        same = same && existsComposedBalancer(4, 4, 4, &threaded, options) && threaded.first == four.first &&
+               threaded.second == four.second && threaded.wiring == four.wiring;
+    }
+    logTestResult("Same halves with threads", same);
+
+    ExactComposition exact;
+    bool exact_found = existsComposedBalancer<ExactMatrix>(4, 4, 4, &exact);
+    logTestResult("Exact composition", exact_found && isBalancer(composedFlow(exact)));
 }
 
 // Returns whether ther is a test with this index
@@ -49,6 +952,54 @@ bool run_test_by_number(int test_number) {
         case 1:
             test_balancer_exists();
             return true;
+        case 2:
+            test_flow_store();
+            return true;
+        case 3:
+            test_matrix();
+            return true;
+        case 4:
+            test_canonical_form();
+            return true;
+        case 5:
+            test_thread_pool();
+            return true;
+        case 6:
+            test_dynamic_flow();
+            return true;
+        case 7:
+            test_flow_batch();
+            return true;
+        case 8:
+            test_owned_network();
+            return true;
+        case 9:
+            test_flow_runs();
+            return true;
+        case 10:
+            test_checkpoint();
+            return true;
+        case 11:
+            test_balancer_database();
+            return true;
+        case 12:
+            test_balancer_sweep();
+            return true;
+        case 13:
+            test_find_balancer();
+            return true;
+        case 14:
+            test_search_stats();
+            return true;
+        case 15:
+            test_random_network();
+            return true;
+        case 16:
+            test_throughput();
+            return true;
+        case 17:
+            test_meet_in_the_middle();
+            return true;
     }
     
     return false;
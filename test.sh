@@ -16,7 +16,7 @@ function test {
 
   # Build test
   echo Building $test_file
-  clang++ -std=c++17 $test_file $LIBS
+  clang++ -std=c++17 -pthread $test_file $LIBS
   mv a.out $binary
   echo Done!
 
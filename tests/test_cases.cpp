@@ -4,17 +4,17 @@
 #include "test_cases.hpp"
 
 TestNet trivialLink() {
-  Network nodes = emptyNetwork(2);
+  OwnedNetwork nodes(2);
 
   link(nodes, 0, 1);
   Row ratios = {1, 1};
 
-  TestNet B = {"Trivial Link", nodes, ratios};
+  TestNet B = {"Trivial Link", move(nodes), ratios};
   return B;
 }
 
 TestNet splitter1_2() {
-  Network nodes = emptyNetwork(4);
+  OwnedNetwork nodes(4);
 
   link(nodes, 0, 1);
   link(nodes, 1, 2);
@@ -22,12 +22,12 @@ TestNet splitter1_2() {
 
   Row ratios = {1, 0.5, 0.5, 0.5};
 
-  TestNet B = {"Splitter 1 -> 2", nodes, ratios};
+  TestNet B = {"Splitter 1 -> 2", move(nodes), ratios};
   return B;
 }
 
 TestNet splitter2_1() {
-  Network nodes = emptyNetwork(4);
+  OwnedNetwork nodes(4);
 
   link(nodes, 0, 2);
   link(nodes, 1, 2);
@@ -35,12 +35,12 @@ TestNet splitter2_1() {
 
   Row ratios = {1, 0, 1, 1};
 
-  TestNet B = {"Splitter 2 -> 1", nodes, ratios};
+  TestNet B = {"Splitter 2 -> 1", move(nodes), ratios};
   return B;
 }
 
 TestNet splitter2_2() {
-  Network nodes = emptyNetwork(5);
+  OwnedNetwork nodes(5);
 
   link(nodes, 0, 2);
   link(nodes, 1, 2);
@@ -49,12 +49,12 @@ TestNet splitter2_2() {
 
   Row ratios = {1, 0, 0.5, 0.5, 0.5};
 
-  TestNet B = {"Splitter 2 -> 2", nodes, ratios};
+  TestNet B = {"Splitter 2 -> 2", move(nodes), ratios};
   return B;
 }
 
 TestNet balancer3_3() {
-  Network nodes = emptyNetwork(10);
+  OwnedNetwork nodes(10);
 
   link(nodes, 0, 3);
   link(nodes, 1, 3);
@@ -71,12 +71,12 @@ TestNet balancer3_3() {
   Row ratios = {1,       0,       0,       1.0 / 2, 1.0 / 6,
                 1.0 / 3, 1.0 / 3, 1.0 / 3, 1.0 / 3, 1.0 / 3};
 
-  TestNet B = {"Balancer 3 -> 3", nodes, ratios};
+  TestNet B = {"Balancer 3 -> 3", move(nodes), ratios};
   return B;
 }
 
 TestNet testnetA() {
-  Network nodes = emptyNetwork(8);
+  OwnedNetwork nodes(8);
 
   link(nodes, 0, 2);
   link(nodes, 1, 2);
@@ -90,12 +90,12 @@ TestNet testnetA() {
 
   Row ratios = {1, 0, 0.5, 1. / 6, 1. / 3, 2. / 3, 1. / 3, 2. / 3};
 
-  TestNet testnet = {"Test Net A", nodes, ratios};
+  TestNet testnet = {"Test Net A", move(nodes), ratios};
   return testnet;
 }
 
 TestNet testnetB() {
-  Network nodes = emptyNetwork(17);
+  OwnedNetwork nodes(17);
 
   link(nodes, 0, 1);
   link(nodes, 2, 1);
@@ -142,6 +142,6 @@ TestNet testnetB() {
       0.26923076923076927,
   };
 
-  TestNet testnet = {"Test Net B", nodes, ratios};
+  TestNet testnet = {"Test Net B", move(nodes), ratios};
   return testnet;
 }
\ No newline at end of file
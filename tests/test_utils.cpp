@@ -1,5 +1,7 @@
 // Tools to run and report tests
 
+#include <algorithm>
+#include <cmath>
 #include <string>
 
 #include "../lib/network_tools.hpp"
@@ -7,19 +9,24 @@
 #include "../lib/utils.hpp"
 #include "test_utils.hpp"
 
+void logTestResult(string name, bool test_passed) {
+  string spacer(max(24 - (int)name.size(), 0), '.');
+
+  if (test_passed) {
+    log("✔️  " + name + spacer + ". Test passed! 😌");
+  } else {
+    log("❌  " + name + spacer + ". Test failed! 🥲 ");
+  }
+}
+
 void test_outputRatio_first_column(TestNet testnet) {
   Matrix flow = outputRatios(testnet.network);
   Row ratios = getColumn(flow, 0);
   bool test_passed = ratios == testnet.ratios;
 
-  string spacer(24 - testnet.name.size(), '.');
-
-  if (test_passed) {
-    log("✔️  " + testnet.name + spacer + ". Test passed! 😌");
-
-  } else {
-    log("❌  " + testnet.name + spacer + ". Test failed! 🥲 ");
+  logTestResult(testnet.name, test_passed);
 
+  if (!test_passed) {
     log("Expected:");
     log(testnet.ratios);
 
@@ -27,3 +34,15 @@ void test_outputRatio_first_column(TestNet testnet) {
     log(ratios);
   }
 }
+
+void test_outputRatio_exact(TestNet testnet) {
+  ExactMatrix flow = outputRatios<ExactMatrix>(testnet.network);
+  ExactRow ratios = getColumn(flow, 0);
+
+  bool test_passed = ratios.size() == testnet.ratios.size();
+  for (int i = 0; test_passed && i < ratios.size(); ++i) {
+    test_passed = fabs(ratios[i].toDouble() - testnet.ratios[i]) < 1e-12;
+  }
+
+  logTestResult(testnet.name + " (exact)", test_passed);
+}
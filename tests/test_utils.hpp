@@ -4,5 +4,12 @@
 
 #include "../lib/types.hpp"
 
+// Report a single named test as passed or failed
+void logTestResult(string name, bool test_passed);
+
 // Compute testnet ratios, and report against first column expected value
-void test_outputRatio_first_column(TestNet testnet);
\ No newline at end of file
+void test_outputRatio_first_column(TestNet testnet);
+
+// Compute testnet ratios with exact fractions, and compare them against the
+// first column expected value
+void test_outputRatio_exact(TestNet testnet);
\ No newline at end of file